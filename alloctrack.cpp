@@ -0,0 +1,201 @@
+/**
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#include "alloctrack.h"
+
+#if defined(TRACK_ALLOC)
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+// The counters must not allocate and must not need dynamic initialization
+// because they are used before main() and in every thread.
+thread_local AllocCounters tCounters;
+thread_local AllocCounters tLastReport;
+thread_local AllocPhase tPhase = ALLOC_OTHER;
+
+std::atomic<uint64_t> gAllocs[ALLOC_PHASE_COUNT];
+std::atomic<uint64_t> gFrees[ALLOC_PHASE_COUNT];
+std::atomic<uint64_t> gBytes[ALLOC_PHASE_COUNT];
+std::atomic<int32_t> gMoves( 0 );
+std::atomic<int32_t> gMovesOverBudget( 0 );
+
+const char* phaseNames[ALLOC_PHASE_COUNT] = { "other", "parse", "decide", "emit" };
+
+void* trackedAlloc( std::size_t size )
+{
+   if ( size == 0 )
+      size = 1;
+   void* p = std::malloc( size );
+   if ( p != nullptr ) {
+      ++tCounters.allocs[tPhase];
+      tCounters.bytes[tPhase] += size;
+      gAllocs[tPhase].fetch_add( 1, std::memory_order_relaxed );
+      gBytes[tPhase].fetch_add( size, std::memory_order_relaxed );
+   }
+   return p;
+}
+
+void trackedFree( void* p )
+{
+   if ( p == nullptr )
+      return;
+   ++tCounters.frees[tPhase];
+   gFrees[tPhase].fetch_add( 1, std::memory_order_relaxed );
+   std::free( p );
+}
+
+void writeCounters( const AllocCounters& c, std::ostream& out )
+{
+   for ( int i = 0; i < ALLOC_PHASE_COUNT; ++i ) {
+      if ( c.allocs[i] == 0 && c.frees[i] == 0 )
+         continue;
+      out << " " << phaseNames[i] << ": " << c.allocs[i] << " new/"
+         << c.frees[i] << " delete/" << c.bytes[i] << " B";
+   }
+}
+
+} // namespace
+
+const AllocCounters& AllocTracker::thisThread()
+{
+   return tCounters;
+}
+
+AllocCounters AllocTracker::process()
+{
+   AllocCounters c;
+   for ( int i = 0; i < ALLOC_PHASE_COUNT; ++i ) {
+      c.allocs[i] = gAllocs[i].load( std::memory_order_relaxed );
+      c.frees[i] = gFrees[i].load( std::memory_order_relaxed );
+      c.bytes[i] = gBytes[i].load( std::memory_order_relaxed );
+   }
+   return c;
+}
+
+AllocPhase AllocTracker::phase()
+{
+   return tPhase;
+}
+
+void AllocTracker::setPhase( AllocPhase phase )
+{
+   tPhase = phase;
+}
+
+bool AllocTracker::reportMove( int32_t round, std::ostream& out )
+{
+   AllocPhaseMarker marker( ALLOC_OTHER );
+   AllocCounters diff;
+   for ( int i = 0; i < ALLOC_PHASE_COUNT; ++i ) {
+      diff.allocs[i] = tCounters.allocs[i] - tLastReport.allocs[i];
+      diff.frees[i] = tCounters.frees[i] - tLastReport.frees[i];
+      diff.bytes[i] = tCounters.bytes[i] - tLastReport.bytes[i];
+   }
+
+   // Allocations in ALLOC_OTHER belong to reporting and setup, not the move.
+   auto moveAllocs = diff.totalAllocs() - diff.allocs[ALLOC_OTHER];
+   bool ok = moveAllocs <= ALLOC_MOVE_BUDGET;
+   ++gMoves;
+   if ( !ok )
+      ++gMovesOverBudget;
+
+   out << ( ok ? " -- " : " ** " ) << "alloc round " << round << ": " << moveAllocs;
+   writeCounters( diff, out );
+   if ( !ok )
+      out << " (over budget " << ALLOC_MOVE_BUDGET << ")";
+   out << "\n";
+
+   tLastReport = tCounters;
+   return ok;
+}
+
+void AllocTracker::reportTotals( std::ostream& out )
+{
+   AllocPhaseMarker marker( ALLOC_OTHER );
+   auto c = process();
+   out << " -- alloc total:";
+   writeCounters( c, out );
+   out << "\n";
+   out << " -- alloc moves over budget: " << gMovesOverBudget << "/" << gMoves << "\n";
+}
+
+int32_t AllocTracker::movesOverBudget()
+{
+   return gMovesOverBudget;
+}
+
+void* operator new( std::size_t size )
+{
+   void* p = trackedAlloc( size );
+   if ( p == nullptr )
+      throw std::bad_alloc();
+   return p;
+}
+
+void* operator new[]( std::size_t size )
+{
+   void* p = trackedAlloc( size );
+   if ( p == nullptr )
+      throw std::bad_alloc();
+   return p;
+}
+
+void* operator new( std::size_t size, const std::nothrow_t& ) noexcept
+{
+   return trackedAlloc( size );
+}
+
+void* operator new[]( std::size_t size, const std::nothrow_t& ) noexcept
+{
+   return trackedAlloc( size );
+}
+
+void operator delete( void* p ) noexcept
+{
+   trackedFree( p );
+}
+
+void operator delete[]( void* p ) noexcept
+{
+   trackedFree( p );
+}
+
+void operator delete( void* p, std::size_t ) noexcept
+{
+   trackedFree( p );
+}
+
+void operator delete[]( void* p, std::size_t ) noexcept
+{
+   trackedFree( p );
+}
+
+void operator delete( void* p, const std::nothrow_t& ) noexcept
+{
+   trackedFree( p );
+}
+
+void operator delete[]( void* p, const std::nothrow_t& ) noexcept
+{
+   trackedFree( p );
+}
+
+#endif
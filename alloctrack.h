@@ -0,0 +1,114 @@
+/**
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#pragma once
+
+// Allocation tracking is enabled with -DTRACK_ALLOC. When it is enabled the
+// global operator new/delete are replaced (alloctrack.cpp) and every
+// allocation is counted per thread and attributed to the innermost active
+// phase marker. When it is disabled the markers compile to nothing.
+
+#include "log.h"
+
+#include <cstdint>
+#include <iostream>
+
+enum AllocPhase
+{
+   ALLOC_OTHER = 0,
+   ALLOC_PARSE,
+   ALLOC_DECIDE,
+   ALLOC_EMIT,
+   ALLOC_PHASE_COUNT
+};
+
+// Maximum number of allocations allowed in a single move.
+#ifndef ALLOC_MOVE_BUDGET
+#define ALLOC_MOVE_BUDGET 0
+#endif
+
+struct AllocCounters
+{
+   uint64_t allocs[ALLOC_PHASE_COUNT];
+   uint64_t frees[ALLOC_PHASE_COUNT];
+   uint64_t bytes[ALLOC_PHASE_COUNT];
+
+   uint64_t totalAllocs() const
+   {
+      uint64_t total = 0;
+      for ( auto n : allocs )
+         total += n;
+      return total;
+   }
+};
+
+#if defined(TRACK_ALLOC)
+
+class AllocTracker
+{
+public:
+   // Counters of the calling thread.
+   static const AllocCounters& thisThread();
+
+   // Counters of all threads since the start of the process.
+   static AllocCounters process();
+
+   static AllocPhase phase();
+   static void setPhase( AllocPhase phase );
+
+   // Report the allocations made by the calling thread since the previous
+   // call. Returns false if the move exceeded ALLOC_MOVE_BUDGET.
+   static bool reportMove( int32_t round, std::ostream& out );
+
+   // Report the process totals and the number of moves over budget.
+   static void reportTotals( std::ostream& out );
+
+   static int32_t movesOverBudget();
+};
+
+class AllocPhaseMarker
+{
+   AllocPhase mPrevious;
+public:
+   AllocPhaseMarker( AllocPhase phase )
+      : mPrevious( AllocTracker::phase() )
+   {
+      AllocTracker::setPhase( phase );
+   }
+
+   ~AllocPhaseMarker()
+   {
+      AllocTracker::setPhase( mPrevious );
+   }
+
+   AllocPhaseMarker( const AllocPhaseMarker& ) = delete;
+   AllocPhaseMarker& operator=( const AllocPhaseMarker& ) = delete;
+};
+
+#define ALLOC_CAT2( a, b ) a ## b
+#define ALLOC_CAT( a, b ) ALLOC_CAT2( a, b )
+#define ALLOC_PHASE( phase ) AllocPhaseMarker ALLOC_CAT( allocPhase_, __LINE__ )( phase )
+#define ALLOC_REPORT_MOVE( round ) AllocTracker::reportMove( round, Logger::stream() )
+#define ALLOC_REPORT_TOTALS() AllocTracker::reportTotals( Logger::stream() )
+
+#else
+
+#define ALLOC_PHASE( phase )
+#define ALLOC_REPORT_MOVE( round )
+#define ALLOC_REPORT_TOTALS()
+
+#endif
@@ -0,0 +1,155 @@
+/**
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+#pragma once
+
+// Compact binary framing for local engines. The engine asks for it with the
+// text command "protocol binary" and the bot answers with the line "protocol
+// binary" when it can switch or "protocol text" when it can not. After that
+// both sides send frames: a 32-bit little-endian length followed by that many
+// bytes of payload. The first byte of the payload is the message type.
+//
+//   S  settings: i32 time bank, i32 time per move, u8 field width, u8 field
+//      height, u8 index of this bot, u8 player count, then for every player
+//      u8 length and the name
+//   R  round: i32 round, u8 this piece, u8 next piece, i8 piece x, i8 piece y
+//   P  player: u8 index, i32 row points, i32 combo, u8 solid rows, u8 rows,
+//      then for every row from the top (width + 31) / 32 u32 words, bit c of
+//      word w set when the cell in column 32 * w + c is blocked; the current
+//      piece and the solid rows are not sent
+//   A  action moves: i32 time left
+//   M  moves (bot to engine): one BinaryMove for every move
+
+#include <cstdint>
+#include <string>
+
+enum BinaryMessage : uint8_t
+{
+   BIN_SETTINGS = 'S',
+   BIN_ROUND = 'R',
+   BIN_PLAYER = 'P',
+   BIN_ACTION = 'A',
+   BIN_MOVES = 'M'
+};
+
+enum BinaryMove : uint8_t
+{
+   BIN_LEFT = 1,
+   BIN_RIGHT,
+   BIN_TURNLEFT,
+   BIN_TURNRIGHT,
+   BIN_DOWN,
+   BIN_DROP
+};
+
+// Larger frames are treated as a broken stream.
+const uint32_t BIN_MAX_FRAME = 1 << 16;
+
+// Appends frames to a buffer.
+class BinaryEncoder
+{
+   std::string& mBuffer;
+   size_t mFrameStart = 0;
+
+public:
+   BinaryEncoder( std::string& buffer )
+      : mBuffer( buffer )
+   { }
+
+   void begin( BinaryMessage type )
+   {
+      mFrameStart = mBuffer.size();
+      put32( 0 );
+      put8( type );
+   }
+
+   // Fill in the length of the frame started with begin().
+   void end()
+   {
+      uint32_t size = mBuffer.size() - mFrameStart - 4;
+      for ( int i = 0; i < 4; ++i )
+         mBuffer[mFrameStart + i] = char( ( size >> ( 8 * i )) & 0xff );
+   }
+
+   void put8( uint8_t v )
+   {
+      mBuffer += char( v );
+   }
+
+   void put32( uint32_t v )
+   {
+      for ( int i = 0; i < 4; ++i )
+         put8( ( v >> ( 8 * i )) & 0xff );
+   }
+
+   void putString( const std::string& s )
+   {
+      put8( s.size() );
+      mBuffer.append( s, 0, 255 );
+   }
+};
+
+// Reads the fields of one payload. Reading past the end sets ok() to false
+// and returns zeros.
+class BinaryDecoder
+{
+   const std::string& mPayload;
+   size_t mPos = 0;
+   bool mOk = true;
+
+public:
+   BinaryDecoder( const std::string& payload )
+      : mPayload( payload )
+   { }
+
+   bool ok() const
+   {
+      return mOk;
+   }
+
+   uint8_t get8()
+   {
+      if ( mPos >= mPayload.size() ) {
+         mOk = false;
+         return 0;
+      }
+      return uint8_t( mPayload[mPos++] );
+   }
+
+   uint32_t get32()
+   {
+      uint32_t v = 0;
+      for ( int i = 0; i < 4; ++i )
+         v |= uint32_t( get8() ) << ( 8 * i );
+      return v;
+   }
+
+   void getString( std::string& s )
+   {
+      size_t size = get8();
+      if ( mPos + size > mPayload.size() ) {
+         mOk = false;
+         size = 0;
+      }
+      s.assign( mPayload, mPos, size );
+      mPos += size;
+   }
+};
+
+inline uint32_t binaryFrameSize( const unsigned char header[4] )
+{
+   return header[0] | ( header[1] << 8 ) | ( header[2] << 16 ) | ( uint32_t( header[3] ) << 24 );
+}
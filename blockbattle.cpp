@@ -21,10 +21,16 @@
  */
 
 #include "game.h"
-#include "parsers.h"
+#include "blockbot.h"
 #include "dumps.h"
-#include "inputhandler.h"
 #include "myai.h"
+#include "alloctrack.h"
+#include "inputreader.h"
+#include "threadpool.h"
+#include "server.h"
+#include "book.h"
+#include "trace.h"
+#include "log.h"
 
 #include <iostream>
 #include <string>
@@ -40,83 +46,25 @@
 
 using namespace std;
 
-class BlockBot
-{
-   std::shared_ptr<TheGame> mpGame;
-   std::shared_ptr<Ai> mpAi;
-   SettingsParser mSettParser;
-   EntityUpdateParser mEntParser;
-   ActionRequestParser mActionParser;
-public:
-   InputHandler mHandler;
-
-public:
-   BlockBot( std::shared_ptr<TheGame> pgame )
-      : mpGame( pgame ), mSettParser( pgame->mpSettings ), mEntParser( pgame )
-   {
-      mSettParser.registerHandlers( mHandler );
-      mEntParser.registerHandlers( mHandler );
-      mActionParser.registerHandlers( mHandler );
-   }
-
-   void setAi( std::shared_ptr<Ai> pai )
-   {
-      mpAi = pai;
-      if ( pai != nullptr )
-         pai->setGame( mpGame );
-      mActionParser.setAi( mpAi );
-   }
-
-   void run( istream& input )
-   {
-      string command, rest;
-      bool starting = true;
-      while ( input >> command ) {
-         if ( starting ) {
-            // we can parse special streams up to the first action; see sendFakeInput
-            if ( command == "action" )
-               starting = false;
-            if ( command == "[[STREAMEND]]" )
-               break;
-         }
-         getline( input, rest );
-         std::stringstream ss( rest );
-         if ( !mHandler.tryHandle( command, ss )) {
-            DBGERR( "Unknown command: " << command << rest << "\n" );
-         }
-      }
-   }
-};
-
-void sendFakeInput( BlockBot& bot )
-{
-   // We define pieces as a setting
-   std::string pieces =
-      "\nsettings piece I 4 0,0,0,0,1,1,1,1,0,0,0,0,0,0,0,0;0,0,1,0,0,0,1,0,0,0,1,0,0,0,1,0"
-      "\nsettings piece J 3 1,0,0,1,1,1,0,0,0;0,1,1,0,1,0,0,1,0;0,0,0,1,1,1,0,0,1;0,1,0,0,1,0,1,1,0"
-      "\nsettings piece L 3 0,0,1,1,1,1,0,0,0;0,1,0,0,1,0,0,1,1;0,0,0,1,1,1,1,0,0;1,1,0,0,1,0,0,1,0"
-      "\nsettings piece O 2 1,1,1,1"
-      "\nsettings piece S 3 0,1,1,1,1,0,0,0,0;0,1,0,0,1,1,0,0,1"
-      "\nsettings piece T 3 0,1,0,1,1,1,0,0,0;0,1,0,0,1,1,0,1,0;0,0,0,1,1,1,0,1,0;0,1,0,1,1,0,0,1,0"
-      "\nsettings piece Z 3 1,1,0,0,1,1,0,0,0;0,0,1,0,1,1,0,1,0"
-      "\n[[STREAMEND]]";
-   std::stringstream ssf( pieces );
-   bot.run( ssf );
-}
-
 #if defined(DEBUG_INTRFC)
 class DebugParser
 {
    std::shared_ptr<TheGame> mpGame;
+   std::shared_ptr<Ai> mpAi;
 public:
-   DebugParser( std::shared_ptr<TheGame> pGame )
-      : mpGame( pGame )
+   DebugParser( std::shared_ptr<TheGame> pGame, std::shared_ptr<Ai> pAi )
+      : mpGame( pGame ), mpAi( pAi )
    { }
    void registerHandlers( InputHandler& parentHandler )
    {
       parentHandler.addHandler( "hello", [](istream&) { DBGMSG( "hi!\n" ); } );
       parentHandler.addHandler( "dump", [this](istream& input) {
-            cerr << Dump( *mpGame );
+            Logger::stream() << Dump( *mpGame );
+            std::string rest;
+            getline( input, rest );
+         });
+      parentHandler.addHandler( "stats", [this](istream& input) {
+            mpAi->writeStats( Logger::stream() );
             std::string rest;
             getline( input, rest );
          });
@@ -136,29 +84,145 @@ public:
 };
 #endif
 
+struct Options
+{
+   std::string bookPath = "opening.book";
+   std::string statsLog;
+   std::string tracePath;
+   std::string serverPath;
+   std::string inputFile;
+   int32_t evalStages = STAGES_ALL;
+   bool mcts = false;
+};
+
+bool parseEvalStages( const std::string& name, int32_t& stages )
+{
+   if ( name == "none" )
+      stages = STAGES_NONE;
+   else if ( name == "landing" )
+      stages = STAGE_LANDING;
+   else if ( name == "all" )
+      stages = STAGES_ALL;
+   else
+      return false;
+   return true;
+}
+
+bool parseOptions( int argc, char* argv[], Options& options )
+{
+   for ( int i = 1; i < argc; ++i ) {
+      std::string arg = argv[i];
+      if ( arg == "--book" && i + 1 < argc )
+         options.bookPath = argv[++i];
+      else if ( arg == "--stats-log" && i + 1 < argc )
+         options.statsLog = argv[++i];
+      else if ( arg == "--trace" && i + 1 < argc )
+         options.tracePath = argv[++i];
+      else if ( arg == "--server" && i + 1 < argc )
+         options.serverPath = argv[++i];
+      else if ( arg == "--eval-stages" && i + 1 < argc ) {
+         if ( !parseEvalStages( argv[++i], options.evalStages )) {
+            DBGERR( "Unknown evaluation stages: " << argv[i] << "\n" );
+            return false;
+         }
+      }
+      else if ( arg == "--ai" && i + 1 < argc ) {
+         std::string name = argv[++i];
+         if ( name != "search" && name != "mcts" ) {
+            DBGERR( "Unknown AI: " << name << "\n" );
+            return false;
+         }
+         options.mcts = name == "mcts";
+      }
+      else if ( arg.size() > 1 && arg[0] == '-' ) {
+         DBGERR( "Unknown option: " << arg << "\n" );
+         return false;
+      }
+      else
+         options.inputFile = arg;
+   }
+   return true;
+}
+
 int main( int argc, char* argv[] )
 {
+   Options options;
+   if ( !parseOptions( argc, argv, options ))
+      return 1;
+   if ( !options.tracePath.empty() ) {
+      Tracer::start( options.tracePath );
+      Tracer::setThreadName( "game" );
+   }
+
+   auto pbook = std::make_shared<OpeningBook>();
+   if ( !pbook->open( options.bookPath ))
+      pbook = nullptr;
+
+   if ( !options.serverPath.empty() ) {
+      // The server thread does no AI work, so all the cores go to the pool.
+      auto ppool = std::make_shared<ThreadPool>( std::max( 1u, std::thread::hardware_concurrency() ));
+      GameServer server( ppool, pbook );
+      server.setEvalStages( options.evalStages );
+      if ( !server.listen( options.serverPath ) || !server.run() )
+         return 1;
+      return 0;
+   }
+
    cout.sync_with_stdio( false );
+   // The reader thread reads cin while this thread writes cout; a tied cin
+   // would flush cout from the reader thread. ActionWriter flushes itself.
+   // The log does not go through cerr, but untie it too so that no other
+   // thread can flush cout.
+   cin.tie( nullptr );
+   cerr.tie( nullptr );
    auto pGame = std::make_shared<TheGame>();
    BlockBot bot( pGame );
    ActionWriter writer( cout );
 
-   auto pai = std::make_shared<MyAi>( writer );
+   auto ppool = std::make_shared<ThreadPool>( std::max( 1u, std::thread::hardware_concurrency() ) - 1 );
+   auto pai = options.mcts ? std::make_shared<MctsAi>( writer, ppool ) : std::make_shared<MyAi>( writer, ppool );
    bot.setAi( pai );
+   pai->setEvalStages( options.evalStages );
+
+   if ( pbook != nullptr )
+      pai->setOpeningBook( pbook );
+
+   std::ofstream statsLog;
+   if ( options.statsLog == "-" )
+      pai->setStatsLog( &Logger::stream() );
+   else if ( !options.statsLog.empty() ) {
+      statsLog.open( options.statsLog );
+      pai->setStatsLog( &statsLog );
+   }
 
    sendFakeInput( bot );
 
+   InputReader reader;
+   pai->setInputMonitor( &reader );
+
 #if defined(DEBUG_INTRFC)
-   DebugParser debug( pGame );
+   DebugParser debug( pGame, pai );
    debug.registerHandlers( bot.mHandler );
-   if ( argc > 1 ) {
-      std::ifstream fin( argv[1] );
-      bot.run( fin );
+   std::ifstream fin;
+   if ( !options.inputFile.empty() ) {
+      fin.open( options.inputFile );
+      reader.start( fin );
    }
    else
-      bot.run( cin );
+      reader.start( cin );
 #else
-   bot.run( cin );
+   reader.start( cin );
+#endif
+   bot.run( reader );
+   reader.join();
+
+   Tracer::finish();
+   ALLOC_REPORT_TOTALS();
+   Logger::finish();
+
+#if defined(TRACK_ALLOC)
+   if ( AllocTracker::movesOverBudget() > 0 )
+      return 2;
 #endif
 
    return 0;
@@ -0,0 +1,120 @@
+/**
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#pragma once
+
+#include "game.h"
+#include "parsers.h"
+#include "inputhandler.h"
+#include "inputreader.h"
+#include "pieces.h"
+#include "alloctrack.h"
+
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+
+#include "defines.h"
+
+// The parsers of one game connected to one AI.
+class BlockBot
+{
+   std::shared_ptr<TheGame> mpGame;
+   std::shared_ptr<Ai> mpAi;
+   SettingsParser mSettParser;
+   EntityUpdateParser mEntParser;
+   ActionRequestParser mActionParser;
+   BinaryParser mBinaryParser;
+public:
+   InputHandler mHandler;
+
+public:
+   BlockBot( std::shared_ptr<TheGame> pgame )
+      : mpGame( pgame ), mSettParser( pgame->mpSettings ), mEntParser( pgame ),
+      mBinaryParser( pgame, mActionParser )
+   {
+      mSettParser.registerHandlers( mHandler );
+      mEntParser.registerHandlers( mHandler );
+      mActionParser.registerHandlers( mHandler );
+      mBinaryParser.registerHandlers( mHandler );
+   }
+
+   void setAi( std::shared_ptr<Ai> pai )
+   {
+      mpAi = pai;
+      if ( pai != nullptr )
+         pai->setGame( mpGame );
+      mActionParser.setAi( mpAi );
+      mBinaryParser.setAi( mpAi );
+   }
+
+   void run( std::istream& input )
+   {
+      std::string command, rest;
+      bool starting = true;
+      ALLOC_PHASE( ALLOC_PARSE );
+      while ( input >> command ) {
+         if ( starting ) {
+            // we can parse special streams up to the first action; see sendFakeInput
+            if ( command == "action" )
+               starting = false;
+            if ( command == "[[STREAMEND]]" )
+               break;
+         }
+         std::getline( input, rest );
+         handle( command, rest );
+      }
+   }
+
+   // Process the commands parsed by the reader thread until the input ends.
+   // The reader can switch to the binary protocol.
+   void run( InputReader& reader )
+   {
+      ALLOC_PHASE( ALLOC_PARSE );
+      mBinaryParser.allow( true );
+      InputCommand cmd;
+      while ( true ) {
+         reader.next( cmd );
+         if ( cmd.kind == InputCommand::END )
+            break;
+         if ( cmd.kind == InputCommand::BINARY )
+            mBinaryParser.handle( cmd.args );
+         else
+            handle( cmd.command, cmd.args );
+      }
+      mBinaryParser.allow( false );
+   }
+
+   // Handle one command; rest is the remainder of its line.
+   void handle( const std::string& command, const std::string& rest )
+   {
+      std::stringstream ss( rest );
+      if ( !mHandler.tryHandle( command, ss )) {
+         DBGERR( "Unknown command: " << command << rest << "\n" );
+      }
+   }
+};
+
+inline void sendFakeInput( BlockBot& bot )
+{
+   // We define pieces as a setting
+   std::string pieces = standardPieces();
+   pieces += "\n[[STREAMEND]]";
+   std::stringstream ssf( pieces );
+   bot.run( ssf );
+}
@@ -0,0 +1,503 @@
+/**
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+#include "board.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "defines.h"
+
+namespace {
+
+uint64_t mix( uint64_t z )
+{
+   z = ( z ^ ( z >> 30 )) * 0xbf58476d1ce4e5b9ull;
+   z = ( z ^ ( z >> 27 )) * 0x94d049bb133111ebull;
+   return z ^ ( z >> 31 );
+}
+
+// The operations on a row of one word.
+template<typename Row>
+struct RowOps
+{
+   static Row cell( int32_t c )
+   {
+      return Row( 1 ) << c;
+   }
+
+   // The cells [0, n).
+   static Row cells( int32_t n )
+   {
+      return n >= RowCells<Row>::value ? ~Row( 0 ) : ( Row( 1 ) << n ) - 1;
+   }
+
+   static bool test( Row row, int32_t c )
+   {
+      return ( row >> c ) & 1;
+   }
+
+   static bool empty( Row row )
+   {
+      return row == 0;
+   }
+
+   static int32_t count( Row row )
+   {
+      return sizeof( Row ) <= sizeof( unsigned ) ? __builtin_popcount( row ) : __builtin_popcountll( row );
+   }
+
+   template<typename Fn>
+   static void forEach( Row bits, Fn fn )
+   {
+      for ( ; bits != 0; bits &= bits - 1 )
+         fn( __builtin_ctzll( bits ));
+   }
+
+   static uint64_t key( Row row )
+   {
+      return row;
+   }
+
+   // The transitions between the cells of the row and the walls. A row of up
+   // to 62 cells is walled in a single word.
+   static int32_t transitions( Row row, int32_t width )
+   {
+      if ( width <= 62 ) {
+         uint64_t walled = uint64_t( row ) << 1 | 1 | 1ull << ( width + 1 );
+         return __builtin_popcountll( ( walled ^ ( walled >> 1 )) & (( 2ull << width ) - 1 ));
+      }
+      return count( ( row ^ ( row >> 1 )) & cells( width - 1 )) + !test( row, 0 ) + !test( row, width - 1 );
+   }
+};
+
+template<int32_t WORDS>
+struct RowOps<WideRow<WORDS>>
+{
+   using Row = WideRow<WORDS>;
+
+   static Row cell( int32_t c )
+   {
+      Row res;
+      res.words[c / 64] = 1ull << ( c % 64 );
+      return res;
+   }
+
+   static Row cells( int32_t n )
+   {
+      Row res;
+      for ( int32_t i = 0; i < WORDS; ++i )
+         res.words[i] = n >= 64 * ( i + 1 ) ? ~0ull : n <= 64 * i ? 0 : ( 1ull << ( n - 64 * i )) - 1;
+      return res;
+   }
+
+   static bool test( const Row& row, int32_t c )
+   {
+      return ( row.words[c / 64] >> ( c % 64 )) & 1;
+   }
+
+   static bool empty( const Row& row )
+   {
+      for ( int32_t i = 0; i < WORDS; ++i )
+         if ( row.words[i] != 0 )
+            return false;
+      return true;
+   }
+
+   static int32_t count( const Row& row )
+   {
+      int32_t total = 0;
+      for ( int32_t i = 0; i < WORDS; ++i )
+         total += __builtin_popcountll( row.words[i] );
+      return total;
+   }
+
+   template<typename Fn>
+   static void forEach( const Row& row, Fn fn )
+   {
+      for ( int32_t i = 0; i < WORDS; ++i )
+         for ( auto bits = row.words[i]; bits != 0; bits &= bits - 1 )
+            fn( 64 * i + __builtin_ctzll( bits ));
+   }
+
+   static uint64_t key( const Row& row )
+   {
+      uint64_t z = 0;
+      for ( int32_t i = 0; i < WORDS; ++i )
+         z = mix( z ^ row.words[i] );
+      return z;
+   }
+
+   static int32_t transitions( const Row& row, int32_t width )
+   {
+      return count( ( row ^ ( row >> 1 )) & cells( width - 1 )) + !test( row, 0 ) + !test( row, width - 1 );
+   }
+};
+
+// Resize the rows to n, or check that n rows fit into the array.
+template<typename T>
+bool resizeRows( std::vector<T>& rows, int32_t n )
+{
+   rows.assign( n, T() );
+   return true;
+}
+
+template<typename T, size_t N>
+bool resizeRows( std::array<T, N>& rows, int32_t n )
+{
+   rows.fill( T() );
+   return n <= int32_t( N );
+}
+
+} // namespace
+
+template<typename Row, int32_t COLUMNS, int32_t ROWS>
+bool BasicBoard<Row, COLUMNS, ROWS>::occupied( int32_t r, int32_t c ) const
+{
+   return RowOps<Row>::test( mRows[r], c );
+}
+
+template<typename Row, int32_t COLUMNS, int32_t ROWS>
+void BasicBoard<Row, COLUMNS, ROWS>::assign( const Field& field )
+{
+   using Ops = RowOps<Row>;
+   mHeight = FieldOps::height( field );
+   if ( COLUMNS == 0 )
+      mWidth = std::min( FieldOps::width( field ), int32_t( MAX_WIDTH ));
+   if ( FieldOps::width( field ) > width() )
+      DBGERR( "The field is wider than " << width() << " cells\n" );
+   mFull = Ops::cells( width() );
+
+   bool fits = resizeRows( mRows, mHeight );
+   resizeRows( mRowFill, mHeight );
+   if ( !fits ) {
+      DBGERR( "The field is higher than " << ROWS << " cells\n" );
+      mHeight = ROWS;
+   }
+   memset( mCounts, 0, sizeof( mCounts ));
+   for ( int32_t r = 0; r < mHeight; ++r ) {
+      const auto& cells = field.rows[r];
+      for ( int32_t c = 0; c < std::min<int32_t>( width(), cells.size() ); ++c ) {
+         if ( cells[c] != 0 ) {
+            mRows[r] |= Ops::cell( c );
+            ++mCounts[c];
+         }
+      }
+      mRowFill[r] = Ops::count( mRows[r] );
+   }
+   recountHeights();
+   rehash();
+   mUndo.clear();
+   mUndo.reserve( 16 );
+}
+
+template<typename Row, int32_t COLUMNS, int32_t ROWS>
+uint64_t BasicBoard<Row, COLUMNS, ROWS>::rowKey( int32_t r, const Row& bits ) const
+{
+   if ( RowOps<Row>::empty( bits ))
+      return 0;
+   return mix( RowOps<Row>::key( bits ) ^ uint64_t( r + 1 ) * 0x9e3779b97f4a7c15ull );
+}
+
+template<typename Row, int32_t COLUMNS, int32_t ROWS>
+void BasicBoard<Row, COLUMNS, ROWS>::rehash()
+{
+   mHash = uint64_t( width() ) << 32 | mHeight;
+   for ( int32_t r = 0; r < mHeight; ++r )
+      mHash ^= rowKey( r, mRows[r] );
+}
+
+template<typename Row, int32_t COLUMNS, int32_t ROWS>
+void BasicBoard<Row, COLUMNS, ROWS>::recountHeights()
+{
+   memset( mHeights, 0, sizeof( mHeights ));
+   Row seen = Row();
+   for ( int32_t r = 0; r < mHeight && seen != mFull; ++r ) {
+      RowOps<Row>::forEach( mRows[r] & ~seen, [&]( int32_t c ) { mHeights[c] = mHeight - r; } );
+      seen |= mRows[r];
+   }
+}
+
+template<typename Row, int32_t COLUMNS, int32_t ROWS>
+int32_t BasicBoard<Row, COLUMNS, ROWS>::holes() const
+{
+   int32_t total = 0;
+   for ( int32_t c = 0; c < width(); ++c )
+      total += mHeights[c] - mCounts[c];
+   return total;
+}
+
+template<typename Row, int32_t COLUMNS, int32_t ROWS>
+int32_t BasicBoard<Row, COLUMNS, ROWS>::maxHeight() const
+{
+   int32_t top = 0;
+   for ( int32_t c = 0; c < width(); ++c )
+      top = std::max<int32_t>( top, mHeights[c] );
+   return top;
+}
+
+template<typename Row, int32_t COLUMNS, int32_t ROWS>
+bool BasicBoard<Row, COLUMNS, ROWS>::fits( const Shape& shape, int32_t x, int32_t y ) const
+{
+   for ( const auto& pt : shape.coords ) {
+      auto r = y + pt.r;
+      auto c = x + pt.c;
+      if ( c < 0 || c >= width() || r >= mHeight )
+         return false;
+      if ( r >= 0 && occupied( r, c ))
+         return false;
+   }
+   return true;
+}
+
+template<typename Row, int32_t COLUMNS, int32_t ROWS>
+int32_t BasicBoard<Row, COLUMNS, ROWS>::dropRow( const Shape& shape, int32_t x, int32_t y ) const
+{
+   while ( fits( shape, x, y + 1 ))
+      ++y;
+   return y;
+}
+
+template<typename Row, int32_t COLUMNS, int32_t ROWS>
+bool BasicBoard<Row, COLUMNS, ROWS>::fillsRow( const Shape& shape, int32_t y ) const
+{
+   for ( int32_t r = std::max( y, 0 ); r < std::min( y + shape.size(), mHeight ); ++r ) {
+      int32_t cells = 0;
+      for ( const auto& pt : shape.coords )
+         if ( y + pt.r == r )
+            ++cells;
+      if ( cells > 0 && mRowFill[r] + cells == width() )
+         return true;
+   }
+   return false;
+}
+
+template<typename Row, int32_t COLUMNS, int32_t ROWS>
+int32_t BasicBoard<Row, COLUMNS, ROWS>::holesAfter( const Shape& shape, int32_t x, int32_t y ) const
+{
+   int32_t total = holes();
+   for ( int32_t sc = 0; sc < shape.size(); ++sc ) {
+      int32_t top = shape.size(), bottom = -1, cells = 0;
+      for ( const auto& pt : shape.coords ) {
+         if ( pt.c != sc )
+            continue;
+         top = std::min( top, pt.r );
+         bottom = std::max( bottom, pt.r );
+         ++cells;
+      }
+      if ( cells == 0 )
+         continue;
+      if ( y + top < 0 )
+         return -1;
+      // The gaps inside the shape and between the shape and the column.
+      auto surface = mHeight - mHeights[x + sc];
+      if ( y + bottom >= surface )
+         return -1;
+      total += bottom - top + 1 - cells + surface - ( y + bottom ) - 1;
+   }
+   return total;
+}
+
+template<typename Row, int32_t COLUMNS, int32_t ROWS>
+int32_t BasicBoard<Row, COLUMNS, ROWS>::place( const Shape& shape, int32_t x, int32_t y )
+{
+   using Ops = RowOps<Row>;
+   mUndo.emplace_back();
+   auto& u = mUndo.back();
+   u.hash = mHash;
+   memcpy( u.heights, mHeights, sizeof( mHeights ));
+   memcpy( u.counts, mCounts, sizeof( mCounts ));
+   u.nCellRows = 0;
+   u.nCleared = 0;
+
+   // The cells of the shape grouped by rows, from the top.
+   for ( int32_t r = std::max( y, 0 ); r < std::min( y + shape.size(), mHeight ); ++r ) {
+      Row mask = Row();
+      for ( const auto& pt : shape.coords )
+         if ( y + pt.r == r )
+            mask |= Ops::cell( x + pt.c );
+      if ( Ops::empty( mask ) || u.nCellRows == MAX_SHAPE_ROWS )
+         continue;
+      u.cellRows[u.nCellRows] = r;
+      u.cellMasks[u.nCellRows] = mask;
+      ++u.nCellRows;
+   }
+
+   int32_t shapeCells = 0;
+   for ( int32_t i = 0; i < u.nCellRows; ++i ) {
+      auto r = u.cellRows[i];
+      auto before = mRows[r];
+      mRows[r] |= u.cellMasks[i];
+      mRowFill[r] = Ops::count( mRows[r] );
+      mHash ^= rowKey( r, before ) ^ rowKey( r, mRows[r] );
+      Ops::forEach( u.cellMasks[i], [&]( int32_t c ) {
+            ++mCounts[c];
+            mHeights[c] = std::max<int16_t>( mHeights[c], mHeight - r );
+         });
+      if ( mRows[r] == mFull ) {
+         u.clearedRows[u.nCleared] = r;
+         u.clearedMasks[u.nCleared] = mRows[r];
+         ++u.nCleared;
+         shapeCells += Ops::count( u.cellMasks[i] );
+      }
+   }
+   if ( u.nCleared == 0 )
+      return 0;
+
+   // Move the rows above the cleared rows down.
+   int32_t dst = mHeight - 1;
+   int32_t next = u.nCleared - 1;
+   for ( int32_t src = mHeight - 1; src >= 0; --src ) {
+      if ( next >= 0 && u.clearedRows[next] == src ) {
+         --next;
+         continue;
+      }
+      mRows[dst] = mRows[src];
+      mRowFill[dst] = mRowFill[src];
+      --dst;
+   }
+   for ( ; dst >= 0; --dst ) {
+      mRows[dst] = Row();
+      mRowFill[dst] = 0;
+   }
+   for ( int32_t c = 0; c < width(); ++c )
+      mCounts[c] -= u.nCleared;
+   recountHeights();
+   rehash();
+   return shapeCells * u.nCleared;
+}
+
+template<typename Row, int32_t COLUMNS, int32_t ROWS>
+void BasicBoard<Row, COLUMNS, ROWS>::undo()
+{
+   using Ops = RowOps<Row>;
+   if ( mUndo.empty() )
+      return;
+   const auto& u = mUndo.back();
+
+   if ( u.nCleared > 0 ) {
+      // Put the cleared rows back; the rows above them move up over the
+      // empty rows at the top.
+      int32_t src = u.nCleared;
+      int32_t next = 0;
+      for ( int32_t r = 0; r < mHeight; ++r ) {
+         if ( next < u.nCleared && u.clearedRows[next] == r )
+            mRows[r] = u.clearedMasks[next++];
+         else
+            mRows[r] = mRows[src++];
+         mRowFill[r] = Ops::count( mRows[r] );
+      }
+   }
+   for ( int32_t i = 0; i < u.nCellRows; ++i ) {
+      auto r = u.cellRows[i];
+      mRows[r] &= ~u.cellMasks[i];
+      mRowFill[r] = Ops::count( mRows[r] );
+   }
+
+   mHash = u.hash;
+   memcpy( mHeights, u.heights, sizeof( mHeights ));
+   memcpy( mCounts, u.counts, sizeof( mCounts ));
+   mUndo.pop_back();
+}
+
+// The same features as a scan of the cells, computed on the row bitmasks.
+template<typename Row, int32_t COLUMNS, int32_t ROWS>
+FieldFeatures BasicBoard<Row, COLUMNS, ROWS>::features( FeatureProfile* pprofile ) const
+{
+   using Ops = RowOps<Row>;
+   FieldFeatures f;
+   if ( pprofile != nullptr ) {
+      resizeRows( pprofile->rowTransitions, mHeight );
+      std::fill_n( pprofile->columnTransitions, MAX_WIDTH, 0 );
+      std::fill_n( pprofile->wells, MAX_WIDTH, 0 );
+   }
+   if ( width() == 0 )
+      return f;
+   f.maxHeight = maxHeight();
+   f.holes = holes();
+
+   // The walls and the floor are occupied, the space above the field is not.
+   const Row leftWall = Ops::cell( 0 );
+   const Row rightWall = Ops::cell( width() - 1 );
+   Row prev = Row();
+   Row active = Row();
+   int16_t depth[MAX_WIDTH];
+   for ( int32_t r = 0; r < mHeight; ++r ) {
+      const auto& row = mRows[r];
+      auto rowTransitions = Ops::transitions( row, width() );
+      f.rowTransitions += rowTransitions;
+      f.columnTransitions += Ops::count( row ^ prev );
+      if ( pprofile != nullptr ) {
+         pprofile->rowTransitions[r] = rowTransitions;
+         Ops::forEach( row ^ prev, [&]( int32_t c ) { ++pprofile->columnTransitions[c]; } );
+      }
+      prev = row;
+
+      // Empty cells with occupied cells or walls on both sides.
+      auto wellCells = ~row & ( row << 1 | leftWall ) & ( row >> 1 | rightWall ) & mFull;
+      Ops::forEach( active & ~wellCells, [&]( int32_t c ) { depth[c] = 0; } );
+      Ops::forEach( wellCells, [&]( int32_t c ) {
+            depth[c] = ( Ops::test( active, c ) ? depth[c] : 0 ) + 1;
+            f.wells += depth[c];
+            if ( pprofile != nullptr )
+               pprofile->wells[c] += depth[c];
+         });
+      active = wellCells;
+   }
+   f.columnTransitions += Ops::count( ~prev & mFull );
+   if ( pprofile != nullptr )
+      Ops::forEach( ~prev & mFull, [&]( int32_t c ) { ++pprofile->columnTransitions[c]; } );
+   return f;
+}
+
+template<typename Row, int32_t COLUMNS, int32_t ROWS>
+void BasicBoard<Row, COLUMNS, ROWS>::placements( const Piece& piece, int32_t spawnX, int32_t spawnY,
+      std::vector<Placement>& result ) const
+{
+   result.clear();
+   auto nshapes = int32_t( piece.shapes.size() );
+   for ( int32_t rot = 0; rot < nshapes; ++rot ) {
+      // Turn in the shorter direction, the same way the moves are emitted.
+      bool reachable = true;
+      auto turns = rot <= nshapes / 2 ? rot : rot - nshapes;
+      for ( int32_t t = 1; t <= std::abs( turns ) && reachable; ++t ) {
+         auto s = ( turns > 0 ? t : nshapes - t ) % nshapes;
+         reachable = fits( piece.shapes[s], spawnX, spawnY );
+      }
+      if ( !reachable )
+         continue;
+
+      const auto& shape = piece.shapes[rot];
+      if ( !fits( shape, spawnX, spawnY ))
+         continue;
+      for ( int32_t dir = -1; dir <= 1; dir += 2 ) {
+         for ( int32_t x = dir < 0 ? spawnX : spawnX + 1; x >= -piece.size && x < width(); x += dir ) {
+            if ( !fits( shape, x, spawnY ))
+               break;
+            Placement pl;
+            pl.rotation = rot;
+            pl.x = x;
+            pl.y = dropRow( shape, x, spawnY );
+            result.push_back( pl );
+         }
+      }
+   }
+}
+
+template class BasicBoard<uint32_t, 10, 20>;
+template class BasicBoard<uint32_t>;
+template class BasicBoard<uint64_t>;
+template class BasicBoard<WideRow<4>>;
@@ -0,0 +1,296 @@
+/**
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+#pragma once
+
+#include "game.h"
+#include "search.h"
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+// A row of more than 64 cells, WORDS words of 64 cells. It supports the bit
+// operations that the board needs on a row.
+template<int32_t WORDS>
+struct WideRow
+{
+   uint64_t words[WORDS] = {};
+
+   WideRow operator|( const WideRow& o ) const
+   {
+      WideRow res;
+      for ( int32_t i = 0; i < WORDS; ++i )
+         res.words[i] = words[i] | o.words[i];
+      return res;
+   }
+
+   WideRow operator&( const WideRow& o ) const
+   {
+      WideRow res;
+      for ( int32_t i = 0; i < WORDS; ++i )
+         res.words[i] = words[i] & o.words[i];
+      return res;
+   }
+
+   WideRow operator^( const WideRow& o ) const
+   {
+      WideRow res;
+      for ( int32_t i = 0; i < WORDS; ++i )
+         res.words[i] = words[i] ^ o.words[i];
+      return res;
+   }
+
+   WideRow operator~() const
+   {
+      WideRow res;
+      for ( int32_t i = 0; i < WORDS; ++i )
+         res.words[i] = ~words[i];
+      return res;
+   }
+
+   WideRow& operator|=( const WideRow& o )
+   {
+      return *this = *this | o;
+   }
+
+   WideRow& operator&=( const WideRow& o )
+   {
+      return *this = *this & o;
+   }
+
+   // Shifts by a single cell; that is all the features need.
+   WideRow operator<<( int32_t ) const
+   {
+      WideRow res;
+      for ( int32_t i = 0; i < WORDS; ++i )
+         res.words[i] = words[i] << 1 | ( i > 0 ? words[i - 1] >> 63 : 0 );
+      return res;
+   }
+
+   WideRow operator>>( int32_t ) const
+   {
+      WideRow res;
+      for ( int32_t i = 0; i < WORDS; ++i )
+         res.words[i] = words[i] >> 1 | ( i + 1 < WORDS ? words[i + 1] << 63 : 0 );
+      return res;
+   }
+
+   bool operator==( const WideRow& o ) const
+   {
+      for ( int32_t i = 0; i < WORDS; ++i )
+         if ( words[i] != o.words[i] )
+            return false;
+      return true;
+   }
+
+   bool operator!=( const WideRow& o ) const
+   {
+      return !( *this == o );
+   }
+};
+
+// The number of cells in a row of type Row.
+template<typename Row>
+struct RowCells
+{
+   static const int32_t value = 8 * sizeof( Row );
+};
+
+template<int32_t WORDS>
+struct RowCells<WideRow<WORDS>>
+{
+   static const int32_t value = 64 * WORDS;
+};
+
+// A fixed array of N elements, or a vector for N == 0.
+template<typename T, int32_t N>
+struct BoardStorage
+{
+   using type = std::array<T, N>;
+};
+
+template<typename T>
+struct BoardStorage<T, 0>
+{
+   using type = std::vector<T>;
+};
+
+// A mutable copy of the playable part of a field for the search. Every row is
+// a bitmask of the occupied cells. place() locks a shape into the board and
+// clears the full rows, undo() restores the board exactly as it was. Both keep
+// the column heights, the filled cells of every row and column, the holes and
+// the hash up to date, so the search needs no copies of the board and no full
+// scans for them. A shape may span at most MAX_SHAPE_ROWS rows.
+//
+// Row is a word for boards of up to 64 columns and a WideRow above that. When
+// COLUMNS is not 0 the width is a constant, otherwise it is taken from the
+// field, up to the cells of a Row. When ROWS is not 0 the rows are kept in
+// arrays of ROWS rows and the playable part may be lower, otherwise in vectors
+// of the height of the field. The instantiations are in board.cpp.
+template<typename Row, int32_t COLUMNS = 0, int32_t ROWS = 0>
+class BasicBoard
+{
+public:
+   static const int32_t MAX_WIDTH = COLUMNS > 0 ? COLUMNS : RowCells<Row>::value;
+   static const int32_t MAX_SHAPE_ROWS = 4;
+
+   // The share of every row and column in the features. A placement that
+   // clears no rows changes only the shares of the rows and columns that it
+   // touches, which gives the search cheap bounds of the features after it.
+   struct FeatureProfile
+   {
+      typename BoardStorage<int32_t, ROWS>::type rowTransitions;
+      int32_t columnTransitions[MAX_WIDTH];
+      int32_t wells[MAX_WIDTH];
+   };
+
+private:
+   struct Undo
+   {
+      uint64_t hash;
+      int16_t heights[MAX_WIDTH];
+      int16_t counts[MAX_WIDTH];
+      int32_t cellRows[MAX_SHAPE_ROWS];
+      Row cellMasks[MAX_SHAPE_ROWS];
+      int32_t nCellRows;
+      int32_t clearedRows[MAX_SHAPE_ROWS]; // from the top, before the clear
+      Row clearedMasks[MAX_SHAPE_ROWS];
+      int32_t nCleared;
+   };
+
+   int32_t mWidth = COLUMNS;
+   int32_t mHeight = 0;
+   Row mFull = Row();
+   typename BoardStorage<Row, ROWS>::type mRows;
+   typename BoardStorage<uint16_t, ROWS>::type mRowFill;
+   int16_t mHeights[MAX_WIDTH];
+   int16_t mCounts[MAX_WIDTH];
+   uint64_t mHash = 0;
+   std::vector<Undo> mUndo;
+
+   uint64_t rowKey( int32_t r, const Row& bits ) const;
+   void rehash();
+   void recountHeights();
+
+public:
+   BasicBoard()
+   { }
+
+   explicit BasicBoard( const Field& field )
+   {
+      assign( field );
+   }
+
+   void assign( const Field& field );
+
+   int32_t width() const
+   {
+      return COLUMNS > 0 ? COLUMNS : mWidth;
+   }
+
+   int32_t height() const
+   {
+      return mHeight;
+   }
+
+   const Row& row( int32_t r ) const
+   {
+      return mRows[r];
+   }
+
+   bool occupied( int32_t r, int32_t c ) const;
+
+   // Height of the column above the floor, 0 when it is empty.
+   int32_t columnHeight( int32_t c ) const
+   {
+      return mHeights[c];
+   }
+
+   // Empty cells below the top of the column.
+   int32_t columnHoles( int32_t c ) const
+   {
+      return mHeights[c] - mCounts[c];
+   }
+
+   int32_t rowFill( int32_t r ) const
+   {
+      return mRowFill[r];
+   }
+
+   int32_t holes() const;
+   int32_t maxHeight() const;
+
+   // Zobrist-style hash of the occupied cells: the xor of a key for every
+   // non-empty row and its position.
+   uint64_t hash() const
+   {
+      return mHash;
+   }
+
+   bool fits( const Shape& shape, int32_t x, int32_t y ) const;
+   int32_t dropRow( const Shape& shape, int32_t x, int32_t y ) const;
+
+   // Whether the shape at row y would fill a row, from the row fills; the
+   // column does not matter.
+   bool fillsRow( const Shape& shape, int32_t y ) const;
+
+   // The holes after the shape is locked at (x, y), from the column heights
+   // and the bottom profile of the shape. Valid only when no row is filled;
+   // -1 when a part of the shape is above the board or below the top of its
+   // column, where it would fill a hole.
+   int32_t holesAfter( const Shape& shape, int32_t x, int32_t y ) const;
+
+   // Lock the shape at (x, y) and clear the full rows. The return value is
+   // the same as for FieldOps::place. The cells above the board are lost.
+   int32_t place( const Shape& shape, int32_t x, int32_t y );
+
+   int32_t place( const Piece& piece, const Placement& placement )
+   {
+      return place( piece.shapes[placement.rotation], placement.x, placement.y );
+   }
+
+   // Undo the last place().
+   void undo();
+
+   // The rows cleared by the last place(), numbered before the clear.
+   int32_t clearedCount() const
+   {
+      return mUndo.empty() ? 0 : mUndo.back().nCleared;
+   }
+
+   int32_t clearedRow( int32_t i ) const
+   {
+      return mUndo.back().clearedRows[i];
+   }
+
+   // The features, and their shares if pprofile is not null.
+   FieldFeatures features( FeatureProfile* pprofile = nullptr ) const;
+
+   // See FieldOps::placements.
+   void placements( const Piece& piece, int32_t spawnX, int32_t spawnY,
+         std::vector<Placement>& result ) const;
+};
+
+// The board of the standard game.
+using StandardBoard = BasicBoard<uint32_t, 10, 20>;
+
+// Boards of any size, chosen by the width.
+using Board = BasicBoard<uint32_t>;
+using WideBoard = BasicBoard<uint64_t>;
+using HugeBoard = BasicBoard<WideRow<4>>;
+
+static_assert( HugeBoard::MAX_WIDTH == MAX_FIELD_WIDTH, "chooseBoardType must not pick a board that is too narrow" );
@@ -0,0 +1,137 @@
+/**
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#include "book.h"
+#include "defines.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+const char BOOK_MAGIC[8] = { 'B', 'B', 'B', 'O', 'O', 'K', 0, 0 };
+
+} // namespace
+
+OpeningBook::~OpeningBook()
+{
+   close();
+}
+
+bool OpeningBook::open( const std::string& path )
+{
+   close();
+   int fd = ::open( path.c_str(), O_RDONLY );
+   if ( fd < 0 )
+      return false;
+
+   struct stat st;
+   if ( fstat( fd, &st ) != 0 || size_t( st.st_size ) < sizeof( BookHeader )) {
+      ::close( fd );
+      return false;
+   }
+   void* p = mmap( nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+   ::close( fd );
+   if ( p == MAP_FAILED )
+      return false;
+
+   mpData = static_cast<const char*>( p );
+   mSize = st.st_size;
+   auto pheader = reinterpret_cast<const BookHeader*>( mpData );
+   if ( memcmp( pheader->magic, BOOK_MAGIC, sizeof( BOOK_MAGIC )) != 0
+         || pheader->version != VERSION
+         || sizeof( BookHeader ) + pheader->count * sizeof( BookEntry ) > mSize ) {
+      DBGERR( "Invalid opening book: " << path << "\n" );
+      close();
+      return false;
+   }
+
+   mpHeader = pheader;
+   mpEntries = reinterpret_cast<const BookEntry*>( mpData + sizeof( BookHeader ));
+   return true;
+}
+
+void OpeningBook::close()
+{
+   if ( mpData != nullptr )
+      munmap( const_cast<char*>( mpData ), mSize );
+   mpData = nullptr;
+   mSize = 0;
+   mpHeader = nullptr;
+   mpEntries = nullptr;
+}
+
+bool OpeningBook::entryLess( const BookEntry& a, const BookEntry& b )
+{
+   if ( a.hash != b.hash )
+      return a.hash < b.hash;
+   if ( a.thisPiece != b.thisPiece )
+      return a.thisPiece < b.thisPiece;
+   return a.nextPiece < b.nextPiece;
+}
+
+bool OpeningBook::lookup( const Field& field, const Piece& thisPiece, char nextPiece,
+      int32_t spawnX, int32_t spawnY, Placement& placement ) const
+{
+   if ( !isOpen() || field.solidRows != 0
+         || FieldOps::width( field ) != mpHeader->fieldWidth
+         || FieldOps::height( field ) != mpHeader->fieldHeight )
+      return false;
+
+   BookEntry key;
+   key.hash = FieldOps::hash( field );
+   key.thisPiece = thisPiece.id;
+   key.nextPiece = nextPiece;
+   auto end = mpEntries + mpHeader->count;
+   auto it = std::lower_bound( mpEntries, end, key, entryLess );
+   if ( it == end || entryLess( key, *it ))
+      return false;
+
+   // Protect against hash collisions and books made with other pieces.
+   Placement pl;
+   pl.rotation = it->rotation;
+   pl.x = it->x;
+   if ( !FieldOps::reachable( field, thisPiece, spawnX, spawnY, pl ))
+      return false;
+   placement = pl;
+   return true;
+}
+
+bool OpeningBook::write( const std::string& path, int32_t fieldWidth, int32_t fieldHeight,
+      std::vector<BookEntry>& entries )
+{
+   std::sort( ITALL( entries ), entryLess );
+
+   BookHeader header;
+   memset( &header, 0, sizeof( header ));
+   memcpy( header.magic, BOOK_MAGIC, sizeof( BOOK_MAGIC ));
+   header.version = VERSION;
+   header.fieldWidth = fieldWidth;
+   header.fieldHeight = fieldHeight;
+   header.count = entries.size();
+
+   std::ofstream out( path, std::ios::binary | std::ios::trunc );
+   out.write( reinterpret_cast<const char*>( &header ), sizeof( header ));
+   out.write( reinterpret_cast<const char*>( entries.data() ), entries.size() * sizeof( BookEntry ));
+   return bool( out );
+}
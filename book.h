@@ -0,0 +1,94 @@
+/**
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#pragma once
+
+#include "game.h"
+#include "search.h"
+
+#include <string>
+#include <vector>
+
+// The opening book maps a position (the hash of the field and the current and
+// the next piece) to the placement found by a deep offline search. The file
+// is written by tools/bookgen.cpp and memory-mapped at runtime.
+//
+// File layout: BookHeader followed by header.count BookEntry records sorted
+// by ( hash, thisPiece, nextPiece ).
+struct BookHeader
+{
+   char magic[8];
+   uint32_t version;
+   uint16_t fieldWidth;
+   uint16_t fieldHeight;
+   uint64_t count;
+};
+
+struct BookEntry
+{
+   uint64_t hash;
+   char thisPiece;
+   char nextPiece;
+   uint8_t rotation;
+   int8_t x;
+   uint32_t reserved;
+};
+
+static_assert( sizeof( BookHeader ) == 24, "BookHeader must be packed" );
+static_assert( sizeof( BookEntry ) == 16, "BookEntry must be packed" );
+
+class OpeningBook
+{
+   const char* mpData = nullptr;
+   size_t mSize = 0;
+   const BookHeader* mpHeader = nullptr;
+   const BookEntry* mpEntries = nullptr;
+
+public:
+   static const uint32_t VERSION = 1;
+
+   OpeningBook() { }
+   ~OpeningBook();
+   OpeningBook( const OpeningBook& ) = delete;
+   OpeningBook& operator=( const OpeningBook& ) = delete;
+
+   // Map the book into memory. Returns false if the file does not exist or
+   // is not a valid book.
+   bool open( const std::string& path );
+   void close();
+
+   bool isOpen() const
+   {
+      return mpHeader != nullptr;
+   }
+
+   size_t size() const
+   {
+      return mpHeader ? mpHeader->count : 0;
+   }
+
+   // Find the placement for the position. The placement is returned only if
+   // it can be reached in the field.
+   bool lookup( const Field& field, const Piece& thisPiece, char nextPiece,
+         int32_t spawnX, int32_t spawnY, Placement& placement ) const;
+
+   static bool entryLess( const BookEntry& a, const BookEntry& b );
+
+   // Sort the entries and write them to a book file.
+   static bool write( const std::string& path, int32_t fieldWidth, int32_t fieldHeight,
+         std::vector<BookEntry>& entries );
+};
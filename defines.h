@@ -22,19 +22,13 @@
 
 #pragma once
 
-#define DBGERR( x ) std::cerr << " ** " << x
+#include "log.h"
 
-#if 1
-#define DBGMSG( x ) std::cerr << " -- " << x
-#else
-#define DBGMSG( x )
-#endif
-
-#if 1
-#define DBGTRACE( x ) std::cerr << " !! " << x << "\n" << std::flush
-#else
-#define DBGTRACE( x )
-#endif
+// The lines are written by the background thread of log.h; build with
+// -DLOG_LEVEL to remove the levels that are not needed.
+#define DBGERR( x ) LOG_LINE( LOG_LEVEL_ERROR, " ** ", x )
+#define DBGMSG( x ) LOG_LINE( LOG_LEVEL_MESSAGE, " -- ", x )
+#define DBGTRACE( x ) LOG_LINE( LOG_LEVEL_TRACE, " !! ", x << "\n" )
 
 #define ITALL( c ) c.begin(), c.end()
 
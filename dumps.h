@@ -104,7 +104,7 @@ void dump( const PlayerState& p, std::ostream& out )
    out << "name: " << p.name << "\n";
    out << "rowPoints: " << p.rowPoints << "\n";
    out << "combo: " << p.combo << "\n";
-   out << "field rows: " << p.field.rows.size();
+   out << "field rows: " << p.field.rows.size() << ", solid rows: " << p.field.solidRows;
    if ( p.field.rows.size() > 0 )
       out << ", row[0]: " << p.field.rows[0].size();
    out << "\n\n";
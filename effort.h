@@ -0,0 +1,88 @@
+/**
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#pragma once
+
+#include "game.h"
+#include "search.h"
+
+#include <algorithm>
+
+// Chooses the search effort for a move from the danger of the position. Easy
+// moves are cheap and save time in the bank; dangerous moves borrow from the
+// bank and use all the threads.
+class EffortController
+{
+   int32_t mMaxThreads;
+   int32_t mMaxDepth;
+
+public:
+   // Time that is never used so that the answer reaches the engine in time.
+   static const int32_t SAFETY_MARGIN = 30; // ms
+
+   EffortController( int32_t maxThreads, int32_t maxDepth = 3 )
+      : mMaxThreads( std::max( 1, maxThreads )), mMaxDepth( std::max( 1, maxDepth ))
+   { }
+
+   // Danger of the position from 0 (empty field) to 1 (about to lose).
+   static double danger( const Field& field, const PlayerState* popponent )
+   {
+      auto height = FieldOps::height( field );
+      if ( height == 0 )
+         return 0;
+      auto f = FieldOps::features( field );
+      double stack = double( f.maxHeight ) / height;
+      double holes = std::min( 1.0, f.holes / 8.0 );
+
+      // A combo of the opponent sends garbage rows soon.
+      double incoming = 0;
+      if ( popponent != nullptr )
+         incoming = std::min( 1.0, popponent->combo / 3.0 );
+
+      return std::min( 1.0, 0.65 * stack * stack + 0.2 * holes + 0.15 * incoming );
+   }
+
+   SearchEffort choose( double danger, int32_t timePerMove, int32_t timeLeft ) const
+   {
+      SearchEffort effort;
+      if ( danger < 0.25 ) {
+         effort.depth = std::min( 2, mMaxDepth );
+         effort.beamWidth = 4;
+         effort.threads = 1;
+         effort.timeBudget = timePerMove / 5;
+      }
+      else if ( danger < 0.5 ) {
+         effort.depth = std::min( 2, mMaxDepth );
+         effort.beamWidth = 0;
+         effort.threads = std::max( 1, mMaxThreads / 2 );
+         effort.timeBudget = timePerMove / 2;
+      }
+      else {
+         // Borrow up to a quarter of the bank that exceeds the time of one
+         // move, more when the danger is higher.
+         double borrow = ( danger - 0.5 ) / 2;
+         effort.depth = mMaxDepth;
+         effort.beamWidth = danger < 0.75 ? 6 : 10;
+         effort.threads = mMaxThreads;
+         effort.timeBudget = timePerMove + int32_t( borrow * std::max( 0, timeLeft - timePerMove ));
+      }
+
+      effort.timeBudget = std::min( effort.timeBudget, timeLeft - SAFETY_MARGIN );
+      effort.timeBudget = std::max( 1, effort.timeBudget );
+      return effort;
+   }
+};
@@ -28,6 +28,10 @@
 #include <memory>
 #include <iostream>
 
+#include "alloctrack.h"
+#include "trace.h"
+#include "binproto.h"
+
 struct Coord
 {
    int32_t r;
@@ -67,17 +71,50 @@ struct Piece
    { }
 };
 
+// The widest field that a board can hold (HugeBoard in board.h).
+const int32_t MAX_FIELD_WIDTH = 256;
+
+// The board that the search uses for the size of the field (board.h).
+enum BoardType
+{
+   BOARD_STANDARD, // 10x20 and lower
+   BOARD_NARROW,   // up to 32 columns
+   BOARD_WIDE,     // up to 64 columns
+   BOARD_HUGE,     // up to MAX_FIELD_WIDTH columns
+   BOARD_NONE      // wider; the field can not be searched
+};
+
 struct Settings
 {
    int32_t timeBank = 0;
    int32_t timePerMove = 0;
    int32_t fieldHeight = 0;
    int32_t fieldWidth = 0;
+   BoardType boardType = BOARD_NARROW;
    std::vector<std::string> playerNames;
    std::string myName;
    std::unordered_map<char, std::shared_ptr<Piece>> pieces;
 };
 
+// Choose the board once the size of the field is known. Returns false if
+// the field is too wide for every board.
+inline bool chooseBoardType( Settings& settings )
+{
+   if ( settings.fieldWidth == 10 && settings.fieldHeight <= 20 )
+      settings.boardType = BOARD_STANDARD;
+   else if ( settings.fieldWidth <= 32 )
+      settings.boardType = BOARD_NARROW;
+   else if ( settings.fieldWidth <= 64 )
+      settings.boardType = BOARD_WIDE;
+   else if ( settings.fieldWidth <= MAX_FIELD_WIDTH )
+      settings.boardType = BOARD_HUGE;
+   else {
+      settings.boardType = BOARD_NONE;
+      return false;
+   }
+   return true;
+}
+
 struct Round
 {
    int32_t id = 0;
@@ -87,11 +124,22 @@ struct Round
    char nextPiece = 0;
 };
 
+// The solid rows that the engine adds to the bottom of the field never clear
+// and nothing can be placed in them. They are not stored in rows, only
+// counted in solidRows, so rows holds only the playable part of the field.
+// The rows are numbered from the top in both cases, so the coordinates in
+// the playable part are the same as in the full field.
 struct Field
 {
    using cell_t = int32_t;
    using row_t = std::vector<cell_t>;
    std::vector<row_t> rows;
+   int32_t solidRows = 0;
+
+   int32_t fullHeight() const
+   {
+      return rows.size() + solidRows;
+   }
 };
 
 struct PlayerState
@@ -133,14 +181,23 @@ struct TheGame
    }
 };
 
+// Writes the moves of the bot as a line of text or, after the binary protocol
+// was negotiated, as a BIN_MOVES frame.
 struct ActionWriter
 {
 protected:
    std::ostream& mOutput;
    bool first = true;
+   bool mBinary = false;
+   std::string mFrame;
 
-   void append( const std::string& command, int32_t nr )
+   void append( const char* command, BinaryMove code, int32_t nr )
    {
+      ALLOC_PHASE( ALLOC_EMIT );
+      if ( mBinary ) {
+         mFrame.append( nr, char( code ));
+         return;
+      }
       while ( nr-- > 0 ) {
          if ( first )
             first = false;
@@ -157,54 +214,101 @@ public:
 
    void emit()
    {
-      mOutput << "\n";
+      ALLOC_PHASE( ALLOC_EMIT );
+      TRACE_SPAN( "emit" );
+      if ( mBinary ) {
+         BinaryEncoder( mFrame ).end();
+         mOutput.write( mFrame.data(), mFrame.size() );
+         mFrame.clear();
+         BinaryEncoder( mFrame ).begin( BIN_MOVES );
+      }
+      else
+         mOutput << "\n";
+      // The engine waits for the moves, they must not stay in the buffer.
+      mOutput << std::flush;
       first = true;
    }
 
+   // Answer the request for the binary protocol and switch to it if allowed.
+   void acceptBinary( bool allowed )
+   {
+      mOutput << ( allowed ? "protocol binary\n" : "protocol text\n" ) << std::flush;
+      if ( !allowed || mBinary )
+         return;
+      mBinary = true;
+      BinaryEncoder( mFrame ).begin( BIN_MOVES );
+   }
+
    void turnRight( int32_t nr=1 )
    {
-      append( "turnright", nr );
+      append( "turnright", BIN_TURNRIGHT, nr );
    }
 
    void turnLeft( int32_t nr=1 )
    {
-      append( "turnleft", nr );
+      append( "turnleft", BIN_TURNLEFT, nr );
    }
 
    void right( int32_t nr=1 )
    {
-      append( "right", nr );
+      append( "right", BIN_RIGHT, nr );
    }
 
    void left( int32_t nr=1 )
    {
-      append( "left", nr );
+      append( "left", BIN_LEFT, nr );
    }
 
    void down( int32_t nr=1 )
    {
-      append( "down", nr );
+      append( "down", BIN_DOWN, nr );
    }
 
    void drop()
    {
-      append( "drop", 1 );
+      append( "drop", BIN_DROP, 1 );
    }
 
 };
 
+// Lets the AI find out that new input arrived while it was thinking.
+class InputMonitor
+{
+public:
+   virtual ~InputMonitor() { }
+   virtual bool inputPending() const = 0;
+};
+
 class Ai
 {
 protected:
    std::shared_ptr<TheGame> mpGame;
-   ActionWriter mAction;
+   ActionWriter& mAction;
    int32_t mTimeLeft;
+   const InputMonitor* mpInputMonitor = nullptr;
 
 public:
    Ai( ActionWriter& writer )
       : mAction( writer )
    { }
 
+   ActionWriter& writer()
+   {
+      return mAction;
+   }
+
+   void setInputMonitor( const InputMonitor* pmonitor )
+   {
+      mpInputMonitor = pmonitor;
+   }
+
+   // A search should check this regularly and stop or adjust when the engine
+   // has already sent the next commands.
+   bool inputPending() const
+   {
+      return mpInputMonitor != nullptr && mpInputMonitor->inputPending();
+   }
+
    void setGame( std::shared_ptr<TheGame> pgame )
    {
       mpGame = pgame;
@@ -256,5 +360,9 @@ public:
    }
 
    virtual void makeSomeMoves() = 0;
+
+   // Report the work done by the AI in the last move and in total.
+   virtual void writeStats( std::ostream& )
+   { }
 };
 
@@ -27,6 +27,8 @@
 #include <functional>
 #include <unordered_map>
 
+#include "trace.h"
+
 class InputHandler
 {
 public:
@@ -50,6 +52,7 @@ public:
       if ( it == mHandlers.end() )
          return false;
 
+      TRACE_SPAN( it->first.c_str() );
       it->second( input );
       return true;
    }
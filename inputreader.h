@@ -0,0 +1,185 @@
+/**
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#pragma once
+
+#include "game.h"
+#include "spscring.h"
+#include "alloctrack.h"
+#include "trace.h"
+#include "binproto.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <chrono>
+
+#include "defines.h"
+
+struct InputCommand
+{
+   enum Kind { COMMAND, BINARY, END };
+   Kind kind = COMMAND;
+   std::string command;
+   std::string args;    // the rest of the line or the payload of a BINARY frame
+};
+
+// Reads the commands from the input in a separate thread and passes them to
+// the game thread through a lock-free ring. The game thread can check
+// inputPending() while it is thinking to find out that the engine has already
+// sent more commands.
+class InputReader: public InputMonitor
+{
+   SpscRing<InputCommand, 256> mRing;
+   std::thread mThread;
+
+   // The game thread sleeps on mReady while the opponent is thinking; the
+   // reader only takes the mutex when the game thread is waiting.
+   std::mutex mMutex;
+   std::condition_variable mReady;
+   std::atomic<bool> mWaiting{ false };
+
+   static void backoff( int32_t& spins )
+   {
+      ++spins;
+      if ( spins < 64 )
+         return;
+      if ( spins < 256 )
+         std::this_thread::yield();
+      else
+         std::this_thread::sleep_for( std::chrono::microseconds( 50 ));
+   }
+
+   void readInput( std::istream& input )
+   {
+      ALLOC_PHASE( ALLOC_PARSE );
+      Tracer::setThreadName( "reader" );
+      bool binary = false;
+      while ( true ) {
+         InputCommand* pcmd;
+         int32_t spins = 0;
+         while ( ( pcmd = mRing.claim() ) == nullptr )
+            backoff( spins );
+
+         if ( binary ? !readFrame( input, *pcmd ) : !readLine( input, *pcmd )) {
+            pcmd->kind = InputCommand::END;
+            pcmd->args.clear();
+            publish();
+            return;
+         }
+         // The game thread answers the request; the frames follow it.
+         if ( pcmd->command == "protocol" && isBinaryRequest( pcmd->args ))
+            binary = true;
+         publish();
+      }
+   }
+
+   void publish()
+   {
+      mRing.publish();
+      // Pairs with the fence in next(): either the game thread sees the
+      // command or the reader sees that it is waiting.
+      std::atomic_thread_fence( std::memory_order_seq_cst );
+      if ( mWaiting.load( std::memory_order_relaxed )) {
+         std::lock_guard<std::mutex> lock( mMutex );
+         mReady.notify_one();
+      }
+   }
+
+   static bool readLine( std::istream& input, InputCommand& cmd )
+   {
+      if ( !( input >> cmd.command ))
+         return false;
+      std::getline( input, cmd.args );
+      cmd.kind = InputCommand::COMMAND;
+      return true;
+   }
+
+   static bool readFrame( std::istream& input, InputCommand& cmd )
+   {
+      unsigned char header[4];
+      if ( !input.read( (char*) header, 4 ))
+         return false;
+      auto size = binaryFrameSize( header );
+      if ( size == 0 || size > BIN_MAX_FRAME ) {
+         DBGERR( "Bad binary frame size: " << size << "\n" );
+         return false;
+      }
+      cmd.kind = InputCommand::BINARY;
+      cmd.command.clear();
+      cmd.args.resize( size );
+      return bool( input.read( &cmd.args[0], size ));
+   }
+
+   static bool isBinaryRequest( const std::string& args )
+   {
+      auto begin = args.find_first_not_of( " \t" );
+      auto end = args.find_last_not_of( " \t\r" );
+      return begin != std::string::npos && args.compare( begin, end + 1 - begin, "binary" ) == 0;
+   }
+
+public:
+   ~InputReader()
+   {
+      if ( mThread.joinable() )
+         mThread.detach();
+   }
+
+   void start( std::istream& input )
+   {
+      mThread = std::thread( [this, &input]() { readInput( input ); } );
+   }
+
+   void join()
+   {
+      if ( mThread.joinable() )
+         mThread.join();
+   }
+
+   // Wait for the next command and move it into cmd. After a short spin the
+   // game thread blocks until the reader publishes a command. The buffers of cmd are
+   // swapped with the buffers of the slot so that neither side allocates once
+   // the buffers have grown.
+   void next( InputCommand& cmd )
+   {
+      InputCommand* pcmd;
+      for ( int32_t spins = 0; ( pcmd = mRing.front() ) == nullptr && spins < 256; )
+         backoff( spins );
+
+      if ( pcmd == nullptr ) {
+         std::unique_lock<std::mutex> lock( mMutex );
+         mWaiting.store( true, std::memory_order_relaxed );
+         std::atomic_thread_fence( std::memory_order_seq_cst );
+         while ( ( pcmd = mRing.front() ) == nullptr )
+            mReady.wait( lock );
+         mWaiting.store( false, std::memory_order_relaxed );
+      }
+
+      cmd.kind = pcmd->kind;
+      cmd.command.swap( pcmd->command );
+      cmd.args.swap( pcmd->args );
+      mRing.pop();
+   }
+
+   bool inputPending() const override
+   {
+      return !mRing.empty();
+   }
+};
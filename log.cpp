@@ -0,0 +1,265 @@
+/**
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#include "log.h"
+#include "spscring.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <streambuf>
+#include <string>
+#include <thread>
+
+#include <unistd.h>
+
+namespace {
+
+// The put area is the text of the claimed record. When it is full the
+// stream goes bad and the rest of the line is ignored.
+class RecordBuf: public std::streambuf
+{
+public:
+   void reset( char* begin, char* end )
+   {
+      setp( begin, end );
+   }
+
+   size_t length() const
+   {
+      return pptr() - pbase();
+   }
+};
+
+// Collects the characters of a line and writes it as a record at the end of
+// the line or when the record is full.
+class LineBuf: public std::streambuf
+{
+   char mLine[LogRecord::TEXT_SIZE];
+   size_t mLength = 0;
+
+   void writeLine()
+   {
+      if ( mLength == 0 )
+         return;
+      LogLine line( "" );
+      line.stream().write( mLine, mLength );
+      mLength = 0;
+   }
+
+protected:
+   int_type overflow( int_type c ) override
+   {
+      if ( traits_type::eq_int_type( c, traits_type::eof() ))
+         return traits_type::not_eof( c );
+      mLine[mLength++] = traits_type::to_char_type( c );
+      if ( c == '\n' || mLength == LogRecord::TEXT_SIZE )
+         writeLine();
+      return c;
+   }
+
+public:
+   ~LineBuf()
+   {
+      writeLine();
+   }
+};
+
+struct LineStream
+{
+   LineBuf buf;
+   std::ostream out{ &buf };
+};
+
+struct ThreadLog
+{
+   SpscRing<LogRecord, Logger::RING_SIZE> ring;
+   std::atomic<uint64_t> dropped{ 0 };
+   std::atomic<uint64_t> truncated{ 0 };
+   bool registered = false;
+   RecordBuf buf;
+   std::ostream out{ &buf };
+};
+
+const std::chrono::milliseconds MIN_PAUSE( 1 );
+const std::chrono::milliseconds MAX_PAUSE( 16 );
+
+// The logs are never freed: a thread may log until the program exits.
+std::atomic<ThreadLog*> gLogs[Logger::MAX_THREADS];
+std::atomic<size_t> gLogCount( 0 );
+std::atomic<uint64_t> gUnregistered( 0 ); // lines of the threads without a ring
+std::atomic<bool> gStop( false );
+std::once_flag gStartOnce;
+std::mutex gFinishMutex;
+std::thread gWriter;
+thread_local ThreadLog* tLog = nullptr;
+
+// Move the published records of all threads to text; returns their number.
+size_t drain( std::string& text )
+{
+   size_t count = 0;
+   auto logs = std::min( gLogCount.load( std::memory_order_acquire ), size_t( Logger::MAX_THREADS ));
+   for ( size_t i = 0; i < logs; ++i ) {
+      auto plog = gLogs[i].load( std::memory_order_acquire );
+      if ( plog == nullptr )
+         continue;
+      while ( auto prec = plog->ring.front() ) {
+         text.append( prec->text, prec->length );
+         plog->ring.pop();
+         ++count;
+      }
+      auto dropped = plog->dropped.exchange( 0, std::memory_order_relaxed );
+      if ( dropped > 0 )
+         text += " ** log: " + std::to_string( dropped ) + " lines dropped\n";
+      auto truncated = plog->truncated.exchange( 0, std::memory_order_relaxed );
+      if ( truncated > 0 )
+         text += " ** log: " + std::to_string( truncated ) + " lines truncated\n";
+   }
+   auto lost = gUnregistered.exchange( 0, std::memory_order_relaxed );
+   if ( lost > 0 )
+      text += " ** log: " + std::to_string( lost ) + " lines of unregistered threads dropped\n";
+   return count;
+}
+
+// Bypasses std::cerr: flushing it would also flush a tied cout from the
+// writer thread while the game thread is writing an answer.
+void write( const std::string& text )
+{
+   auto data = text.data();
+   auto left = text.size();
+   while ( left > 0 ) {
+      auto written = ::write( STDERR_FILENO, data, left );
+      if ( written < 0 ) {
+         if ( errno == EINTR )
+            continue;
+         return;
+      }
+      data += written;
+      left -= written;
+   }
+}
+
+void writeLoop()
+{
+   std::string text;
+   auto pause = MIN_PAUSE;
+   while ( !gStop.load( std::memory_order_acquire )) {
+      text.clear();
+      if ( drain( text ) > 0 )
+         pause = MIN_PAUSE;
+      else
+         pause = std::min( pause * 2, MAX_PAUSE );
+      write( text );
+      std::this_thread::sleep_for( pause );
+   }
+}
+
+void finishAtExit()
+{
+   Logger::finish();
+}
+
+void startWriter()
+{
+   gWriter = std::thread( writeLoop );
+   std::atexit( finishAtExit );
+}
+
+ThreadLog& threadLog()
+{
+   if ( tLog == nullptr ) {
+      // The ring is aligned to the cache lines, which new does not promise
+      // before C++17.
+      void* memory = nullptr;
+      if ( posix_memalign( &memory, alignof( ThreadLog ), sizeof( ThreadLog )) != 0 )
+         throw std::bad_alloc();
+      tLog = new ( memory ) ThreadLog;
+      auto index = gLogCount.fetch_add( 1, std::memory_order_relaxed );
+      if ( index < Logger::MAX_THREADS ) {
+         tLog->registered = true;
+         gLogs[index].store( tLog, std::memory_order_release );
+         std::call_once( gStartOnce, startWriter );
+      }
+   }
+   return *tLog;
+}
+
+} // namespace
+
+void Logger::finish()
+{
+   std::lock_guard<std::mutex> lock( gFinishMutex );
+   if ( gWriter.joinable() ) {
+      gStop = true;
+      gWriter.join();
+   }
+   // Also the lines that were logged after the writer stopped.
+   std::string text;
+   drain( text );
+   write( text );
+}
+
+std::ostream& Logger::stream()
+{
+   thread_local LineStream stream;
+   return stream.out;
+}
+
+LogLine::LogLine( const char* prefix )
+   : mpRecord( nullptr )
+{
+   auto& log = threadLog();
+   if ( log.registered ) {
+      mpRecord = log.ring.claim();
+      if ( mpRecord == nullptr )
+         log.dropped.fetch_add( 1, std::memory_order_relaxed );
+   }
+   else
+      gUnregistered.fetch_add( 1, std::memory_order_relaxed );
+
+   log.out.clear();
+   if ( mpRecord != nullptr ) {
+      log.buf.reset( mpRecord->text, mpRecord->text + LogRecord::TEXT_SIZE );
+      log.out << prefix;
+   }
+   else {
+      log.buf.reset( nullptr, nullptr );
+      log.out.setstate( std::ios::badbit );
+   }
+}
+
+LogLine::~LogLine()
+{
+   if ( mpRecord == nullptr )
+      return;
+   auto& log = *tLog;
+   mpRecord->length = log.buf.length();
+   if ( log.out.bad() ) {
+      mpRecord->text[LogRecord::TEXT_SIZE - 1] = '\n';
+      log.truncated.fetch_add( 1, std::memory_order_relaxed );
+   }
+   log.ring.publish();
+}
+
+std::ostream& LogLine::stream()
+{
+   return tLog->out;
+}
@@ -0,0 +1,91 @@
+/**
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#pragma once
+
+// Asynchronous logging. A log line is formatted in place into a record in a
+// ring of the calling thread and a background thread writes the records to
+// stderr, so a slow stderr never stalls the caller. When the ring is full the
+// line is dropped, a line longer than a record is truncated, and the writer
+// reports how many lines were lost or cut. The remaining records are written
+// by Logger::finish() or at exit.
+//
+// LOG_LEVEL selects the levels at compile time; the lines above it are
+// removed by the compiler.
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+#define LOG_LEVEL_NONE    0
+#define LOG_LEVEL_ERROR   1
+#define LOG_LEVEL_MESSAGE 2
+#define LOG_LEVEL_TRACE   3
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_TRACE
+#endif
+
+struct LogRecord
+{
+   static const size_t TEXT_SIZE = 252; // longer lines are truncated
+
+   uint32_t length;
+   char text[TEXT_SIZE];
+};
+
+class Logger
+{
+public:
+   // Number of records in the ring of every thread.
+   static const size_t RING_SIZE = 1024;
+
+   // Number of threads that get a ring; the lines of the others are dropped.
+   static const size_t MAX_THREADS = 256;
+
+   // Write the remaining records and stop the writer thread.
+   static void finish();
+
+   // The log as a stream of the calling thread, for the reports that are
+   // written to an ostream. Every line becomes a record without a prefix;
+   // longer lines continue in the next record.
+   static std::ostream& stream();
+};
+
+// Formats one line into a record of the calling thread and publishes it when
+// it goes out of scope. Use the LOG_LINE macro.
+class LogLine
+{
+   LogRecord* mpRecord;
+
+public:
+   explicit LogLine( const char* prefix );
+   ~LogLine();
+
+   std::ostream& stream();
+
+   LogLine( const LogLine& ) = delete;
+   LogLine& operator=( const LogLine& ) = delete;
+};
+
+#define LOG_LINE( level, prefix, x ) \
+   do { \
+      if ( LOG_LEVEL >= ( level )) { \
+         LogLine logLine_( prefix ); \
+         logLine_.stream() << x; \
+      } \
+   } while ( 0 )
@@ -0,0 +1,538 @@
+/**
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#include "mcts.h"
+#include "board.h"
+#include "defines.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+// The state of the children of a node when it has none yet.
+const int32_t NONE = -1; // not created
+const int32_t BUSY = -2; // being created by another thread
+const int32_t FULL = -3; // the pool was full, the node stays a leaf
+
+const int32_t VIRTUAL_LOSS = 3;
+const int32_t HORIZON = 4;           // plies of a line of play, in the tree and the rollout
+const int32_t EXPAND_VISITS = 4;     // of a position before its piece is expanded
+const int32_t BASELINE_ROLLOUTS = 8;
+const double EXPLORATION = 0.5;
+const double REWARD_SCALE = 20;      // the value above the baseline that gives the reward 0.73
+const double FIXED_ONE = 1 << 20;    // the reward 1 in the sums of the nodes
+
+uint64_t nextRandom( uint64_t& state )
+{
+   state ^= state >> 12;
+   state ^= state << 25;
+   state ^= state >> 27;
+   return state * 0x2545f4914f6cdd1dull;
+}
+
+bool locksAbove( const Shape& shape, int32_t y )
+{
+   for ( const auto& pt : shape.coords )
+      if ( y + pt.r < 0 )
+         return true;
+   return false;
+}
+
+} // namespace
+
+// A decision node holds the piece to place and has a child for every
+// placement; a position node holds the placement that led to it and has a
+// child for the next piece, or for every piece when it is not known. The
+// visits include the virtual losses of the threads that are below the node.
+struct MctsNode
+{
+   std::atomic<int32_t> visits;
+   std::atomic<int64_t> rewards; // in units of 1 / FIXED_ONE
+   std::atomic<int32_t> first;   // the index of the first child, or NONE, BUSY or FULL
+   int32_t count;                // of the children, valid when first >= 0
+   Placement placement;
+   const Piece* ppiece;
+};
+
+// The scratch of one search thread.
+template<typename B>
+struct MctsWorker
+{
+   B board;
+   std::vector<Placement> placements;
+   std::vector<double> scores;
+   std::vector<int32_t> path;
+   uint64_t rand = 1;
+   int32_t depth = 0; // the deepest ply reached in the tree
+   SearchStats stats;
+};
+
+MonteCarloSearcher::MonteCarloSearcher( ThreadPool& pool, size_t nodes, const Weights& weights )
+   : mPool( pool ), mWeights( weights ), mpNodes( new MctsNode[nodes] ), mpForward( new int32_t[nodes] ),
+   mCapacity( nodes )
+{
+}
+
+MonteCarloSearcher::~MonteCarloSearcher()
+{
+}
+
+bool MonteCarloSearcher::shouldStop()
+{
+   if ( mAborted.load( std::memory_order_relaxed ))
+      return true;
+   if ( clock::now() >= mDeadline || ( mpMonitor != nullptr && mpMonitor->inputPending() )) {
+      mAborted = true;
+      return true;
+   }
+   return false;
+}
+
+// Take count consecutive nodes from the pool; NONE when it is full.
+int32_t MonteCarloSearcher::allocate( int32_t count )
+{
+   auto first = mUsed.fetch_add( count, std::memory_order_relaxed );
+   if ( first + count > mCapacity )
+      return NONE;
+   for ( size_t i = first; i < first + count; ++i ) {
+      auto& n = mpNodes[i];
+      n.visits.store( 0, std::memory_order_relaxed );
+      n.rewards.store( 0, std::memory_order_relaxed );
+      n.first.store( NONE, std::memory_order_relaxed );
+      n.count = 0;
+      n.ppiece = nullptr;
+   }
+   return int32_t( first );
+}
+
+double MonteCarloSearcher::reward( double value, bool lost ) const
+{
+   return lost ? 0 : 1 / ( 1 + std::exp( ( mBaseline - value ) / REWARD_SCALE ));
+}
+
+// The child of a decision node with the best upper confidence bound.
+int32_t MonteCarloSearcher::select( int32_t node ) const
+{
+   const auto& n = mpNodes[node];
+   auto first = n.first.load( std::memory_order_acquire );
+   auto logVisits = std::log( double( std::max( 1, n.visits.load( std::memory_order_relaxed ))));
+   int32_t best = first;
+   double bestBound = std::numeric_limits<double>::lowest();
+   for ( int32_t i = first; i < first + n.count; ++i ) {
+      const auto& ch = mpNodes[i];
+      double visits = std::max( 1, ch.visits.load( std::memory_order_relaxed ));
+      double bound = ch.rewards.load( std::memory_order_relaxed ) / FIXED_ONE / visits
+         + EXPLORATION * std::sqrt( logVisits / visits );
+      if ( bound > bestBound ) {
+         best = i;
+         bestBound = bound;
+      }
+   }
+   return best;
+}
+
+// Create the decision nodes below a position, the known piece at ply or
+// every piece. Returns the first of them or NONE if the position stays a
+// leaf for now.
+int32_t MonteCarloSearcher::branch( int32_t node, int32_t ply )
+{
+   auto& n = mpNodes[node];
+   auto first = n.first.load( std::memory_order_acquire );
+   if ( first != NONE )
+      return first >= 0 ? first : NONE;
+   if ( !n.first.compare_exchange_strong( first, BUSY, std::memory_order_acq_rel ))
+      return first >= 0 ? first : NONE;
+
+   bool known = ply < int32_t( mSequence.size() );
+   auto count = known ? 1 : int32_t( mAllPieces.size() );
+   first = allocate( count );
+   if ( first == NONE ) {
+      n.first.store( FULL, std::memory_order_release );
+      return NONE;
+   }
+   for ( int32_t i = 0; i < count; ++i )
+      mpNodes[first + i].ppiece = known ? mSequence[ply] : mAllPieces[i];
+   n.count = count;
+   n.first.store( first, std::memory_order_release );
+   return first;
+}
+
+// Move the subtree of root to the front of the pool, root first. Below the
+// children of root the chance nodes keep only the child of pnext, the piece
+// that is known now. A node is allocated after its parent, so a scan in the
+// order of the pool reaches the parents first and every node moves to a
+// lower index. Returns the number of nodes kept.
+int32_t MonteCarloSearcher::compact( int32_t root, const Piece* pnext )
+{
+   auto used = int32_t( std::min( mUsed.load(), mCapacity ));
+   auto forward = mpForward.get();
+   std::fill( forward + root, forward + used, NONE );
+
+   // Mark the kept nodes and number them in the order of the pool.
+   const auto& r = mpNodes[root];
+   auto rootFirst = r.first.load( std::memory_order_relaxed );
+   auto rootEnd = rootFirst >= 0 ? rootFirst + r.count : rootFirst;
+   int32_t kept = 0;
+   forward[root] = 0;
+   for ( int32_t i = root; i < used; ++i ) {
+      if ( forward[i] == NONE )
+         continue;
+      forward[i] = kept++;
+      const auto& n = mpNodes[i];
+      auto first = n.first.load( std::memory_order_relaxed );
+      if ( first < 0 )
+         continue;
+      bool chance = pnext != nullptr && i >= rootFirst && i < rootEnd && n.count > 1;
+      for ( int32_t c = first; c < first + n.count; ++c )
+         if ( !chance || mpNodes[c].ppiece == pnext )
+            forward[c] = 0;
+   }
+
+   // The kept children of a node are consecutive, all of them or one.
+   for ( int32_t i = root; i < used; ++i ) {
+      if ( forward[i] == NONE )
+         continue;
+      auto& n = mpNodes[i];
+      auto first = n.first.load( std::memory_order_relaxed );
+      auto count = n.count;
+      if ( first == FULL )
+         first = NONE; // there is room again
+      else if ( first >= 0 && count > 0 ) {
+         auto begin = first;
+         while ( begin < first + count && forward[begin] == NONE )
+            ++begin;
+         auto end = begin;
+         while ( end < first + count && forward[end] != NONE )
+            ++end;
+         first = begin < end ? forward[begin] : NONE;
+         count = end - begin;
+      }
+      auto& to = mpNodes[forward[i]];
+      to.visits.store( n.visits.load( std::memory_order_relaxed ), std::memory_order_relaxed );
+      to.rewards.store( n.rewards.load( std::memory_order_relaxed ), std::memory_order_relaxed );
+      to.first.store( first, std::memory_order_relaxed );
+      to.count = count;
+      to.placement = n.placement;
+      to.ppiece = n.ppiece;
+   }
+   mUsed = kept;
+   return kept;
+}
+
+// Create the children of a decision node on the position of the board. A
+// child starts with one visit whose reward is the immediate score of the
+// placement relative to the best one, so the first visits go to the
+// placements that look good. Returns the first child or NONE if the node
+// stays a leaf for now.
+template<typename B>
+int32_t MonteCarloSearcher::expand( MctsWorker<B>& w, int32_t node )
+{
+   auto& n = mpNodes[node];
+   auto first = n.first.load( std::memory_order_acquire );
+   if ( first != NONE )
+      return first >= 0 ? first : NONE;
+   if ( !n.first.compare_exchange_strong( first, BUSY, std::memory_order_acq_rel ))
+      return first >= 0 ? first : NONE;
+
+   auto& board = w.board;
+   const auto& piece = *n.ppiece;
+   // Only the root has the spawn position of the round.
+   auto spawnX = node == 0 ? mSpawnX : ( board.width() - piece.size ) / 2;
+   board.placements( piece, spawnX, mSpawnY, w.placements );
+   ++w.stats.nodes;
+   w.stats.placements += w.placements.size();
+   auto count = int32_t( w.placements.size() );
+   if ( count == 0 ) {
+      n.count = 0;
+      n.first.store( 0, std::memory_order_release );
+      return 0;
+   }
+   first = allocate( count );
+   if ( first == NONE ) {
+      n.first.store( FULL, std::memory_order_release );
+      return NONE;
+   }
+
+   w.scores.clear();
+   double best = std::numeric_limits<double>::lowest();
+   for ( const auto& pl : w.placements ) {
+      const auto& shape = piece.shapes[pl.rotation];
+      double score = std::numeric_limits<double>::lowest();
+      if ( !locksAbove( shape, pl.y )) {
+         auto eroded = board.place( shape, pl.x, pl.y );
+         score = placementScore( mWeights, board.height(), shape, pl.y, eroded )
+            + featureScore( mWeights, board.features() );
+         board.undo();
+         ++w.stats.evaluations;
+      }
+      w.scores.push_back( score );
+      best = std::max( best, score );
+   }
+   for ( int32_t i = 0; i < count; ++i ) {
+      auto& ch = mpNodes[first + i];
+      auto prior = w.scores[i] == std::numeric_limits<double>::lowest() ? 0
+         : 1 / ( 1 + std::exp( ( best - w.scores[i] ) / REWARD_SCALE ));
+      ch.placement = w.placements[i];
+      ch.visits.store( 1, std::memory_order_relaxed );
+      ch.rewards.store( int64_t( prior * FIXED_ONE ), std::memory_order_relaxed );
+   }
+   n.count = count;
+   n.first.store( first, std::memory_order_release );
+   return first;
+}
+
+// Play greedy placements of the known and then random pieces from ply up to
+// the horizon, starting with ppiece if it is not null. The policy only
+// looks at the landing height, the holes that a placement covers and whether
+// it fills a row; the value of the line uses the full evaluation at the end.
+template<typename B>
+double MonteCarloSearcher::rollout( MctsWorker<B>& w, int32_t ply, const Piece* ppiece, bool& lost )
+{
+   auto& board = w.board;
+   double value = 0;
+   for ( ; ply < HORIZON; ++ply ) {
+      if ( ppiece == nullptr ) {
+         ppiece = ply < int32_t( mSequence.size() ) ? mSequence[ply]
+            : mAllPieces[nextRandom( w.rand ) % mAllPieces.size()];
+      }
+      const auto& piece = *ppiece;
+      ppiece = nullptr;
+      board.placements( piece, ( board.width() - piece.size ) / 2, mSpawnY, w.placements );
+      w.stats.placements += w.placements.size();
+
+      auto holes = board.holes();
+      const Placement* pbest = nullptr;
+      double best = std::numeric_limits<double>::lowest();
+      for ( const auto& pl : w.placements ) {
+         const auto& shape = piece.shapes[pl.rotation];
+         if ( locksAbove( shape, pl.y ))
+            continue;
+         auto score = placementScore( mWeights, board.height(), shape, pl.y, 0 );
+         if ( board.fillsRow( shape, pl.y ))
+            score += mWeights.erodedCells * shape.coords.size();
+         else {
+            auto after = board.holesAfter( shape, pl.x, pl.y );
+            if ( after > holes )
+               score += mWeights.holes * ( after - holes );
+         }
+         if ( score > best ) {
+            best = score;
+            pbest = &pl;
+         }
+      }
+
+      if ( pbest == nullptr ) {
+         lost = true;
+         return value;
+      }
+      const auto& shape = piece.shapes[pbest->rotation];
+      auto eroded = board.place( shape, pbest->x, pbest->y );
+      value += placementScore( mWeights, board.height(), shape, pbest->y, eroded );
+   }
+   ++w.stats.evaluations;
+   return value + featureScore( mWeights, board.features() );
+}
+
+// One descent from the root, a rollout and the backup of its reward.
+template<typename B>
+void MonteCarloSearcher::iterate( MctsWorker<B>& w, const B& root )
+{
+   auto& board = w.board;
+   board = root;
+   w.path.clear();
+   double value = 0;
+   bool lost = false;
+   int32_t ply = 0;
+   const Piece* pfirst = nullptr; // the piece of a decision node that stays a leaf
+   int32_t node = 0;
+   while ( true ) {
+      auto& n = mpNodes[node];
+      n.visits.fetch_add( VIRTUAL_LOSS, std::memory_order_relaxed );
+      w.path.push_back( node );
+      if ( expand( w, node ) == NONE ) {
+         pfirst = n.ppiece;
+         break;
+      }
+      if ( n.count == 0 ) {
+         lost = true;
+         break;
+      }
+
+      auto child = select( node );
+      auto& ch = mpNodes[child];
+      auto visits = ch.visits.fetch_add( VIRTUAL_LOSS, std::memory_order_relaxed );
+      w.path.push_back( child );
+      const auto& shape = n.ppiece->shapes[ch.placement.rotation];
+      if ( locksAbove( shape, ch.placement.y )) {
+         lost = true;
+         break;
+      }
+      auto eroded = board.place( shape, ch.placement.x, ch.placement.y );
+      value += placementScore( mWeights, board.height(), shape, ch.placement.y, eroded );
+      ++ply;
+
+      // The tree grows only up to the horizon, so that every line has the
+      // same number of plies, in the tree and in the rollout together.
+      if ( visits < EXPAND_VISITS || ply >= HORIZON )
+         break;
+      auto first = branch( child, ply );
+      if ( first == NONE )
+         break;
+      // A chance node: the pieces are equally likely.
+      node = ch.count == 1 ? first : first + int32_t( nextRandom( w.rand ) % ch.count );
+   }
+   w.depth = std::max( w.depth, ply );
+
+   if ( !lost )
+      value += rollout( w, ply, pfirst, lost );
+   ++w.stats.rollouts;
+   auto fixed = int64_t( reward( value, lost ) * FIXED_ONE );
+   for ( auto i : w.path ) {
+      mpNodes[i].visits.fetch_add( 1 - VIRTUAL_LOSS, std::memory_order_relaxed );
+      mpNodes[i].rewards.fetch_add( fixed, std::memory_order_relaxed );
+   }
+}
+
+MonteCarloSearcher::Result MonteCarloSearcher::search( const Field& field, const Settings& settings,
+      const Round& round, const SearchEffort& effort )
+{
+   Result result;
+   mDeadline = clock::now() + std::chrono::milliseconds( effort.timeBudget );
+   mAborted = false;
+
+   mAllPieces.clear();
+   for ( const auto& p : settings.pieces )
+      mAllPieces.push_back( p.second.get() );
+   std::sort( ITALL( mAllPieces ), []( const Piece* a, const Piece* b ) { return a->id < b->id; } );
+
+   auto pthis = settings.pieces.find( round.thisPiece );
+   if ( pthis == settings.pieces.end() || FieldOps::height( field ) == 0 )
+      return result;
+   mSequence.assign( 1, pthis->second.get() );
+   auto pnext = settings.pieces.find( round.nextPiece );
+   if ( pnext != settings.pieces.end() )
+      mSequence.push_back( pnext->second.get() );
+   mSpawnX = round.pieceX;
+   mSpawnY = round.pieceY;
+
+   switch ( settings.boardType ) {
+   case BOARD_STANDARD:
+      searchOn<StandardBoard>( field, round, effort, result );
+      break;
+   case BOARD_NARROW:
+      searchOn<Board>( field, round, effort, result );
+      break;
+   case BOARD_WIDE:
+      searchOn<WideBoard>( field, round, effort, result );
+      break;
+   case BOARD_HUGE:
+      searchOn<HugeBoard>( field, round, effort, result );
+      break;
+   case BOARD_NONE:
+      break;
+   }
+   return result;
+}
+
+template<typename B>
+void MonteCarloSearcher::searchOn( const Field& field, const Round& round, const SearchEffort& effort,
+      Result& result )
+{
+   B root( field );
+   size_t threads = std::max( 1, effort.threads );
+   std::vector<MctsWorker<B>> workers( threads );
+   for ( size_t i = 0; i < threads; ++i )
+      workers[i].rand = ( uint64_t( round.id ) << 8 | ( i + 1 )) * 0x9e3779b97f4a7c15ull;
+
+   // The reward 0.5 is the mean value of the greedy play from the root.
+   auto& w0 = workers[0];
+   double total = 0;
+   int32_t played = 0;
+   for ( int32_t i = 0; i < BASELINE_ROLLOUTS; ++i ) {
+      w0.board = root;
+      bool lost = false;
+      auto value = rollout( w0, 0, nullptr, lost );
+      if ( !lost ) {
+         total += value;
+         ++played;
+      }
+   }
+   mBaseline = played > 0 ? total / played : 0;
+
+   // Continue with the tree of the previous round if it predicted this
+   // position. Its rewards are relative to the previous baseline; the new
+   // rollouts refine them. Below the root the pieces spawn in the middle, so
+   // the root must too.
+   const auto& piece = *mSequence[0];
+   int32_t reused = 0;
+   if ( mKeptNode >= 0 && root.hash() == mKeptHash && root.height() == mKeptHeight
+         && mpNodes[mKeptNode].ppiece == &piece && mSpawnX == ( root.width() - piece.size ) / 2 )
+      reused = compact( mKeptNode, mSequence.size() > 1 ? mSequence[1] : nullptr );
+   mKeptNode = NONE;
+   if ( reused == 0 ) {
+      mUsed = 0;
+      allocate( 1 );
+      mpNodes[0].ppiece = &piece;
+   }
+   w0.board = root;
+   expand( w0, 0 );
+   const auto& rootNode = mpNodes[0];
+   if ( rootNode.first.load() < 0 || rootNode.count == 0 )
+      return;
+
+   mPool.parallelFor( threads, threads, [&]( size_t i ) {
+         TRACE_SPAN( "rollouts", "thread", i );
+         auto& w = workers[i];
+         while ( !shouldStop() )
+            iterate( w, root );
+      });
+
+   // The most visited placement, the one with the better mean on a tie.
+   auto first = rootNode.first.load();
+   int32_t best = first;
+   for ( int32_t i = first + 1; i < first + rootNode.count; ++i ) {
+      const auto& a = mpNodes[i];
+      const auto& b = mpNodes[best];
+      auto va = a.visits.load(), vb = b.visits.load();
+      if ( va > vb || ( va == vb && a.rewards.load() > b.rewards.load() ))
+         best = i;
+   }
+
+   for ( const auto& w : workers ) {
+      result.stats.addWork( w.stats );
+      result.depthReached = std::max( result.depthReached, w.depth );
+   }
+   result.stats.reused += reused;
+
+   // The decision node of the next piece under the chosen placement is the
+   // root of the next round if the position does not change meanwhile.
+   const auto& chosen = mpNodes[best];
+   auto below = chosen.first.load();
+   if ( below >= 0 && chosen.count == 1 ) {
+      w0.board = root;
+      w0.board.place( piece.shapes[chosen.placement.rotation], chosen.placement.x, chosen.placement.y );
+      mKeptNode = below;
+      mKeptHash = w0.board.hash();
+      mKeptHeight = w0.board.height();
+   }
+   result.found = true;
+   result.placement = mpNodes[best].placement;
+   result.reward = double( mpNodes[best].rewards.load() ) / FIXED_ONE / std::max( 1, mpNodes[best].visits.load() );
+}
@@ -0,0 +1,114 @@
+/**
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#pragma once
+
+#include "game.h"
+#include "search.h"
+#include "threadpool.h"
+#include "stats.h"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <vector>
+
+struct MctsNode;
+template<typename B>
+struct MctsWorker;
+
+// Monte-Carlo tree search over the placements. The tree alternates between
+// decision nodes, a piece to place on a position, and the positions after a
+// placement. The piece after the next piece is not known, so a position
+// after the next piece is a chance node with a child for every piece and the
+// search samples them. Every iteration descends by UCT, expands a node and
+// plays a rollout from it: greedy placements of random pieces up to a fixed
+// number of plies. The rollouts run on all the threads of the effort; a
+// thread that passes a node adds a virtual loss to it, so the other threads
+// spread over the other children until the result is backed up.
+//
+// The nodes live in a pool that is allocated once and reused by every
+// search. When the pool is full the tree stops growing and the search only
+// refines the statistics of the nodes that it has. When the next round starts
+// from the predicted position, the subtree of the chosen placement and the
+// piece that actually came is moved to the front of the pool and the search
+// continues from it; the rest of the pool is free again.
+class MonteCarloSearcher
+{
+public:
+   using clock = std::chrono::steady_clock;
+
+   static const size_t DEFAULT_NODES = 1 << 19;
+
+   struct Result
+   {
+      bool found = false;
+      Placement placement;
+      double reward = 0; // mean of the rewards of the chosen placement, 0 to 1
+      int32_t depthReached = 0;
+      SearchStats stats;
+   };
+
+private:
+   ThreadPool& mPool;
+   Weights mWeights;
+   std::unique_ptr<MctsNode[]> mpNodes;
+   std::unique_ptr<int32_t[]> mpForward; // the new index of a node while compacting
+   size_t mCapacity;
+   std::atomic<size_t> mUsed{ 0 };
+   int32_t mKeptNode = -1;     // the decision node of the next round, -1 if none
+   uint64_t mKeptHash = 0;     // of the position that it expects
+   int32_t mKeptHeight = 0;
+   std::vector<const Piece*> mAllPieces;
+   std::vector<const Piece*> mSequence;
+   int32_t mSpawnX = 0;  // of the current piece; the others spawn in the middle
+   int32_t mSpawnY = -1;
+   double mBaseline = 0; // the value that gives the reward 0.5
+   clock::time_point mDeadline;
+   const InputMonitor* mpMonitor = nullptr;
+   std::atomic<bool> mAborted{ false };
+
+   bool shouldStop();
+   int32_t allocate( int32_t count );
+   double reward( double value, bool lost ) const;
+   int32_t select( int32_t node ) const;
+   int32_t branch( int32_t node, int32_t ply );
+   int32_t compact( int32_t root, const Piece* pnext );
+
+   // The search is instantiated for every board type in mcts.cpp.
+   template<typename B>
+   int32_t expand( MctsWorker<B>& w, int32_t node );
+   template<typename B>
+   double rollout( MctsWorker<B>& w, int32_t ply, const Piece* ppiece, bool& lost );
+   template<typename B>
+   void iterate( MctsWorker<B>& w, const B& root );
+   template<typename B>
+   void searchOn( const Field& field, const Round& round, const SearchEffort& effort, Result& result );
+
+public:
+   MonteCarloSearcher( ThreadPool& pool, size_t nodes = DEFAULT_NODES, const Weights& weights = Weights() );
+   ~MonteCarloSearcher();
+
+   void setInputMonitor( const InputMonitor* pmonitor )
+   {
+      mpMonitor = pmonitor;
+   }
+
+   // Run the iterations until the time budget runs out or new input arrives.
+   Result search( const Field& field, const Settings& settings, const Round& round,
+         const SearchEffort& effort );
+};
@@ -28,14 +28,89 @@ void MyAi::dropToColumn( int32_t nx )
    mAction.drop();
 }
 
+void MyAi::emitPlacement( const Placement& placement )
+{
+   auto nshapes = int32_t( currentPiece()->shapes.size() );
+   auto rot = placement.rotation;
+   if ( rot <= nshapes / 2 )
+      mAction.turnRight( rot );
+   else
+      mAction.turnLeft( nshapes - rot );
+   dropToColumn( placement.x );
+}
+
 void MyAi::makeSomeMoves()
 {
-   int32_t nr = mRand() % currentPiece()->shapes.size();
-   if ( nr > 0 )
-      mAction.turnRight( nr );
+   auto start = Searcher::clock::now();
+   mLastStats = SearchStats();
+   mLastStats.moves = 1;
+
+   chooseMove();
+
+   mLastStats.timeUsed = std::chrono::duration<double, std::milli>( Searcher::clock::now() - start ).count();
+   mTotalStats.add( mLastStats );
+   if ( mpStatsLog != nullptr )
+      mLastStats.writeLine( *mpStatsLog, round()->id );
+}
+
+void MyAi::chooseMove()
+{
+   auto pplayer = player();
+   auto pround = round();
+
+   Placement placement;
+   if ( mpBook != nullptr && mpBook->isOpen() ) {
+      ++mLastStats.bookLookups;
+      if ( mpBook->lookup( pplayer->field, *currentPiece(), pround->nextPiece,
+               pround->pieceX, pround->pieceY, placement )) {
+         ++mLastStats.bookHits;
+         emitPlacement( placement );
+         mAction.emit();
+         return;
+      }
+   }
+
+   auto popponent = opponent();
+   auto danger = EffortController::danger( pplayer->field, popponent.get() );
+   auto effort = mEffort.choose( danger, settings()->timePerMove, mTimeLeft );
+   mLastStats.timeBudget = effort.timeBudget;
+   mLastStats.depthLimit = effort.depth;
 
-   int32_t nx = mRand() % settings()->fieldWidth;
-   dropToColumn( nx );
+   if ( searchPlacement( effort, placement ))
+      emitPlacement( placement );
+   else
+      mAction.drop();
 
    mAction.emit();
 }
+
+bool MyAi::searchPlacement( const SearchEffort& effort, Placement& placement )
+{
+   mSearcher.setInputMonitor( mpInputMonitor );
+   auto result = mSearcher.search( player()->field, *settings(), *round(), effort );
+   mLastStats.addWork( result.stats );
+   mLastStats.depthReached = result.depthReached;
+   placement = result.placement;
+   return result.found;
+}
+
+bool MctsAi::searchPlacement( const SearchEffort& effort, Placement& placement )
+{
+   // More rollouts never hurt, so every move gets all the threads.
+   auto rollouts = effort;
+   rollouts.threads = mpPool->size() + 1;
+   mMcts.setInputMonitor( mpInputMonitor );
+   auto result = mMcts.search( player()->field, *settings(), *round(), rollouts );
+   mLastStats.addWork( result.stats );
+   mLastStats.depthReached = result.depthReached;
+   placement = result.placement;
+   return result.found;
+}
+
+void MyAi::writeStats( std::ostream& out )
+{
+   out << "## Last move:\n";
+   mLastStats.write( out );
+   out << "## All moves:\n";
+   mTotalStats.write( out );
+}
@@ -18,17 +18,66 @@
 #pragma once
 
 #include "game.h"
-#include <random>
+#include "search.h"
+#include "mcts.h"
+#include "effort.h"
+#include "book.h"
+#include "threadpool.h"
+#include <memory>
 
 #include "defines.h"
 
 class MyAi: public Ai
 {
-   std::mt19937 mRand;
+protected:
+   std::shared_ptr<ThreadPool> mpPool;
+   Searcher mSearcher;
+   EffortController mEffort;
+   std::shared_ptr<const OpeningBook> mpBook;
+   SearchStats mLastStats;
+   SearchStats mTotalStats;
+   std::ostream* mpStatsLog = nullptr;
 public:
-   MyAi( ActionWriter& writer )
-      : Ai( writer ), mRand(time(0))
+   MyAi( ActionWriter& writer, std::shared_ptr<ThreadPool> ppool )
+      : Ai( writer ), mpPool( ppool ), mSearcher( *ppool ), mEffort( ppool->size() + 1 )
    { }
+   void setOpeningBook( std::shared_ptr<const OpeningBook> pbook )
+   {
+      mpBook = pbook;
+   }
+   // The cheap stages of the placement evaluation, see EvalStage.
+   void setEvalStages( int32_t stages )
+   {
+      mSearcher.setStages( stages );
+   }
+   // Write a line of stats after every move to the stream.
+   void setStatsLog( std::ostream* plog )
+   {
+      mpStatsLog = plog;
+   }
    void dropToColumn( int32_t nx );
+   void emitPlacement( const Placement& placement );
    void makeSomeMoves() override;
+   void writeStats( std::ostream& out ) override;
+protected:
+   // Find the placement of the current piece within the effort and count the
+   // work in mLastStats. Returns false when the piece can not be placed.
+   virtual bool searchPlacement( const SearchEffort& effort, Placement& placement );
+private:
+   void chooseMove();
+};
+
+// The same bot with a Monte-Carlo tree search instead of the heuristic
+// lookahead. The book, the effort and the stats work the same way; the time
+// budget of the effort is the deadline of the rollouts.
+class MctsAi: public MyAi
+{
+   MonteCarloSearcher mMcts;
+public:
+   MctsAi( ActionWriter& writer, std::shared_ptr<ThreadPool> ppool,
+         size_t nodes = MonteCarloSearcher::DEFAULT_NODES )
+      : MyAi( writer, ppool ), mMcts( *ppool, nodes )
+   { }
+protected:
+   bool searchPlacement( const SearchEffort& effort, Placement& placement ) override;
 };
@@ -30,9 +30,23 @@
 #include <sstream>
 #include <memory>
 #include <unordered_map>
+#include <algorithm>
 
+#include "alloctrack.h"
+#include "binproto.h"
+#include "trace.h"
 #include "defines.h"
 
+// Choose the board for the size of the field; a field that is too wide is
+// reported once, whichever of its settings comes first, and the AI does not
+// search it.
+inline void updateBoardType( Settings& settings )
+{
+   bool reported = settings.boardType == BOARD_NONE;
+   if ( !chooseBoardType( settings ) && !reported )
+      DBGERR( "The field is wider than " << MAX_FIELD_WIDTH << " columns\n" );
+}
+
 class SettingsParser
 {
    InputHandler mHandler;
@@ -63,9 +77,9 @@ public:
       mHandler.addHandler( "time_per_move", [this]( std::istream& input )
          { input >> mpSettings->timePerMove; });
       mHandler.addHandler( "field_height", [this]( std::istream& input )
-         { input >> mpSettings->fieldHeight; });
+         { input >> mpSettings->fieldHeight; updateBoardType( *mpSettings ); });
       mHandler.addHandler( "field_width", [this]( std::istream& input )
-         { input >> mpSettings->fieldWidth; });
+         { input >> mpSettings->fieldWidth; updateBoardType( *mpSettings ); });
       mHandler.addHandler( "your_bot", [this]( std::istream& input )
          { input >> mpSettings->myName; });
       mHandler.addHandler( "player_names", [this]( std::istream& input )
@@ -208,6 +222,21 @@ private:
          }
          mpState->field.rows.push_back(row);
       }
+
+      auto& rows = mpState->field.rows;
+      mpState->field.solidRows = 0;
+      while ( !rows.empty() && isSolid( rows.back() )) {
+         rows.pop_back();
+         ++mpState->field.solidRows;
+      }
+   }
+
+   static bool isSolid( const Field::row_t& row )
+   {
+      for ( auto v : row )
+         if ( v != 3 )
+            return false;
+      return !row.empty();
    }
 };
 
@@ -285,10 +314,136 @@ public:
                return;
             }
             input >> timeleft;
-            if ( mpAi != nullptr ) {
-               mpAi->setTimeLeft( timeleft );
-               mpAi->makeSomeMoves();
-            }
+            requestMoves( timeleft );
+         });
+   }
+
+   void requestMoves( int32_t timeleft )
+   {
+      if ( mpAi == nullptr )
+         return;
+      {
+         ALLOC_PHASE( ALLOC_DECIDE );
+         TRACE_SPAN( "makeSomeMoves" );
+         mpAi->setTimeLeft( timeleft );
+         mpAi->makeSomeMoves();
+      }
+      ALLOC_REPORT_MOVE( mpAi->round()->id );
+   }
+};
+
+// Negotiates the binary protocol (see binproto.h) and applies the binary
+// messages to the same game state as the text parsers. The moves are
+// requested through the ActionRequestParser.
+class BinaryParser
+{
+   std::shared_ptr<TheGame> mpGame;
+   ActionRequestParser& mActionParser;
+   std::shared_ptr<Ai> mpAi;
+   bool mAllowed = false;
+
+public:
+   BinaryParser( std::shared_ptr<TheGame> pGame, ActionRequestParser& actionParser )
+      : mpGame( pGame ), mActionParser( actionParser )
+   { }
+
+   void setAi( std::shared_ptr<Ai> pai )
+   {
+      mpAi = pai;
+   }
+
+   // The binary protocol is refused unless the input can switch to it.
+   void allow( bool allowed )
+   {
+      mAllowed = allowed;
+   }
+
+   void registerHandlers( InputHandler& parentHandler )
+   {
+      parentHandler.addHandler( "protocol", [this]( std::istream& input )
+         {
+            std::string what;
+            input >> what;
+            if ( mpAi != nullptr )
+               mpAi->writer().acceptBinary( mAllowed && what == "binary" );
          });
    }
+
+   void handle( const std::string& payload )
+   {
+      BinaryDecoder in( payload );
+      auto type = in.get8();
+      switch ( type ) {
+         case BIN_SETTINGS: readSettings( in ); break;
+         case BIN_ROUND: readRound( in ); break;
+         case BIN_PLAYER: readPlayer( in ); break;
+         case BIN_ACTION: {
+            int32_t timeleft = in.get32();
+            if ( in.ok() )
+               mActionParser.requestMoves( timeleft );
+            break;
+         }
+         default:
+            DBGERR( "Unknown binary message: " << int( type ) << "\n" );
+            return;
+      }
+      if ( !in.ok() )
+         DBGERR( "Binary message too short: " << char( type ) << "\n" );
+   }
+
+private:
+   void readSettings( BinaryDecoder& in )
+   {
+      auto& settings = *mpGame->mpSettings;
+      settings.timeBank = in.get32();
+      settings.timePerMove = in.get32();
+      settings.fieldWidth = in.get8();
+      settings.fieldHeight = in.get8();
+      updateBoardType( settings );
+      size_t me = in.get8();
+      size_t count = in.get8();
+      settings.playerNames.resize( count );
+      for ( auto& name : settings.playerNames )
+         in.getString( name );
+      if ( me < count )
+         settings.myName = settings.playerNames[me];
+   }
+
+   void readRound( BinaryDecoder& in )
+   {
+      auto& round = *mpGame->mpRound;
+      round.id = in.get32();
+      round.thisPiece = in.get8();
+      round.nextPiece = in.get8();
+      round.pieceX = int8_t( in.get8() );
+      round.pieceY = int8_t( in.get8() );
+   }
+
+   void readPlayer( BinaryDecoder& in )
+   {
+      mpGame->initPlayers();
+      size_t index = in.get8();
+      if ( index >= mpGame->mPlayers.size() ) {
+         DBGERR( "Unknown player: " << index << "\n" );
+         return;
+      }
+      auto& state = *mpGame->mPlayers[index];
+      state.rowPoints = in.get32();
+      state.combo = in.get32();
+      state.field.solidRows = in.get8();
+      size_t height = in.get8();
+      size_t width = std::max( mpGame->mpSettings->fieldWidth, 0 );
+
+      // Reuse the rows so that no memory is allocated once the field exists.
+      auto& rows = state.field.rows;
+      rows.resize( height );
+      for ( auto& row : rows ) {
+         row.resize( width );
+         for ( size_t word = 0; word < width; word += 32 ) {
+            auto bits = in.get32();
+            for ( size_t c = word; c < std::min( word + 32, width ); ++c )
+               row[c] = ( bits >> ( c - word )) & 1 ? 2 : 0;
+         }
+      }
+   }
 };
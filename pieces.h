@@ -0,0 +1,58 @@
+/**
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#pragma once
+
+#include "game.h"
+#include "inputhandler.h"
+#include "parsers.h"
+
+#include <memory>
+#include <sstream>
+#include <string>
+
+// The engine does not send the shapes of the pieces. They are defined here as
+// settings commands and parsed with SettingsParser. Shape i of a piece is the
+// piece turned right i times.
+inline const char* standardPieces()
+{
+   return
+      "settings piece I 4 0,0,0,0,1,1,1,1,0,0,0,0,0,0,0,0;0,0,1,0,0,0,1,0,0,0,1,0,0,0,1,0"
+      "\nsettings piece J 3 1,0,0,1,1,1,0,0,0;0,1,1,0,1,0,0,1,0;0,0,0,1,1,1,0,0,1;0,1,0,0,1,0,1,1,0"
+      "\nsettings piece L 3 0,0,1,1,1,1,0,0,0;0,1,0,0,1,0,0,1,1;0,0,0,1,1,1,1,0,0;1,1,0,0,1,0,0,1,0"
+      "\nsettings piece O 2 1,1,1,1"
+      "\nsettings piece S 3 0,1,1,1,1,0,0,0,0;0,1,0,0,1,1,0,0,1"
+      "\nsettings piece T 3 0,1,0,1,1,1,0,0,0;0,1,0,0,1,1,0,1,0;0,0,0,1,1,1,0,1,0;0,1,0,1,1,0,0,1,0"
+      "\nsettings piece Z 3 1,1,0,0,1,1,0,0,0;0,0,1,0,1,1,0,1,0"
+      "\n";
+}
+
+// Parse the standard pieces into settings. Used by the tools that do not
+// read them from the input stream.
+inline void loadStandardPieces( std::shared_ptr<Settings> psettings )
+{
+   InputHandler handler;
+   SettingsParser parser( psettings );
+   parser.registerHandlers( handler );
+   std::stringstream input( standardPieces() );
+   std::string command, rest;
+   while ( input >> command ) {
+      std::getline( input, rest );
+      std::stringstream ss( rest );
+      handler.tryHandle( command, ss );
+   }
+}
@@ -0,0 +1,564 @@
+/**
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#include "search.h"
+#include "board.h"
+#include "defines.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <limits>
+#include <numeric>
+
+namespace {
+
+const double LOST_SCORE = -1e6;
+
+struct Child
+{
+   Placement placement;
+   double moveScore;
+   double boardScore;
+};
+
+bool byImmediateScore( const Child& a, const Child& b )
+{
+   return a.moveScore + a.boardScore > b.moveScore + b.boardScore;
+}
+
+template<typename B>
+uint64_t nodeKey( const B& board, const Piece& piece, int32_t spawnX, int32_t spawnY )
+{
+   uint64_t z = board.hash()
+      ^ ( uint64_t( uint8_t( piece.id )) << 16 | uint64_t( uint8_t( spawnX )) << 8 | uint8_t( spawnY ));
+   z = ( z ^ ( z >> 30 )) * 0xbf58476d1ce4e5b9ull;
+   z = ( z ^ ( z >> 27 )) * 0x94d049bb133111ebull;
+   return z ^ ( z >> 31 );
+}
+
+template<typename B>
+double boardScore( const Weights& w, const B& board )
+{
+   return featureScore( w, board.features() );
+}
+
+// The features of the board after the shape is locked at (x, y), weighted,
+// with a lower bound of the holes. The rows and the columns that the shape
+// does not touch keep their shares of the transitions, a touched row that is
+// not filled keeps at least two transitions at the walls and a touched column
+// at least one at the floor or its top, and the wells change only in the
+// touched columns and beside them. A cell of the shape below the top of its
+// column fills a hole, any other cell can only add holes. Valid only when no
+// row is filled; no bound when a part of the shape is above the board.
+template<typename B>
+double boardBound( const Weights& w, const B& board, const FieldFeatures& f,
+      const typename B::FeatureProfile& profile, const Shape& shape, int32_t x, int32_t y )
+{
+   uint32_t rows = 0, cols = 0;
+   int32_t holes = board.holes();
+   for ( const auto& pt : shape.coords ) {
+      if ( y + pt.r < 0 )
+         return std::numeric_limits<double>::max();
+      rows |= 1u << pt.r;
+      cols |= 1u << pt.c;
+      if ( y + pt.r >= board.height() - board.columnHeight( x + pt.c ))
+         --holes;
+   }
+
+   double rowTransitions = f.rowTransitions, columnTransitions = f.columnTransitions, wells = f.wells;
+   for ( int32_t r = 0; rows >> r; ++r ) {
+      if ( ( rows >> r ) & 1 )
+         rowTransitions += 2 - profile.rowTransitions[y + r];
+   }
+   // The columns from x - 1 whose wells may change.
+   uint32_t wellCols = 0;
+   for ( int32_t c = 0; cols >> c; ++c ) {
+      if ( ( cols >> c ) & 1 ) {
+         columnTransitions += 1 - profile.columnTransitions[x + c];
+         for ( auto nc = std::max( 0, x + c - 1 ); nc <= std::min( board.width() - 1, x + c + 1 ); ++nc )
+            wellCols |= 1u << ( nc - x + 1 );
+      }
+   }
+   for ( ; wellCols != 0; wellCols &= wellCols - 1 )
+      wells -= profile.wells[x - 1 + __builtin_ctz( wellCols )];
+
+   return w.rowTransitions * rowTransitions + w.columnTransitions * columnTransitions
+      + w.holes * holes + w.wells * wells;
+}
+
+} // namespace
+
+// The placements of a piece in a position with their immediate scores, the
+// best first. Only the best `keep` placements (all for 0) are certain to be
+// among the children; the others may have been rejected by the cheap stages.
+// A node does not change once it is created, so the nodes can be shared by
+// the trees of consecutive searches.
+struct SearchNode
+{
+   std::vector<Child> children;
+   size_t candidates = 0;
+   size_t keep = 0;
+
+   bool keeps( size_t n ) const
+   {
+      return keep == 0 || ( n != 0 && n <= keep );
+   }
+};
+
+bool FieldOps::fits( const Field& field, const Shape& shape, int32_t x, int32_t y )
+{
+   auto w = width( field );
+   auto h = height( field );
+   for ( const auto& pt : shape.coords ) {
+      auto r = y + pt.r;
+      auto c = x + pt.c;
+      if ( c < 0 || c >= w || r >= h )
+         return false;
+      if ( r >= 0 && field.rows[r][c] != 0 )
+         return false;
+   }
+   return true;
+}
+
+int32_t FieldOps::dropRow( const Field& field, const Shape& shape, int32_t x, int32_t y )
+{
+   while ( fits( field, shape, x, y + 1 ))
+      ++y;
+   return y;
+}
+
+int32_t FieldOps::place( Field& field, const Shape& shape, int32_t x, int32_t y, int32_t& cleared )
+{
+   auto w = width( field );
+   for ( const auto& pt : shape.coords ) {
+      auto r = y + pt.r;
+      if ( r >= 0 )
+         field.rows[r][x + pt.c] = 2;
+   }
+
+   int32_t shapeCells = 0;
+   cleared = 0;
+   for ( int32_t r = 0; r < height( field ); ++r ) {
+      const auto& row = field.rows[r];
+      bool full = true;
+      for ( int32_t c = 0; c < w && full; ++c )
+         full = row[c] != 0 && row[c] != 3;
+      if ( !full )
+         continue;
+      for ( const auto& pt : shape.coords )
+         if ( y + pt.r == r )
+            ++shapeCells;
+      field.rows.erase( field.rows.begin() + r );
+      field.rows.insert( field.rows.begin(), Field::row_t( w, 0 ));
+      ++cleared;
+   }
+   return shapeCells * cleared;
+}
+
+FieldFeatures FieldOps::features( const Field& field )
+{
+   if ( width( field ) <= Board::MAX_WIDTH )
+      return Board( field ).features();
+   if ( width( field ) <= WideBoard::MAX_WIDTH )
+      return WideBoard( field ).features();
+   return HugeBoard( field ).features();
+}
+
+uint64_t FieldOps::hash( const Field& field )
+{
+   auto mix = []( uint64_t z ) {
+      z = ( z ^ ( z >> 30 )) * 0xbf58476d1ce4e5b9ull;
+      z = ( z ^ ( z >> 27 )) * 0x94d049bb133111ebull;
+      return z ^ ( z >> 31 );
+   };
+   uint64_t h = mix( uint64_t( width( field )) << 32 | height( field ));
+   for ( const auto& row : field.rows ) {
+      for ( size_t c0 = 0; c0 < row.size(); c0 += 64 ) {
+         uint64_t bits = 0;
+         for ( size_t c = c0; c < row.size() && c < c0 + 64; ++c )
+            if ( row[c] != 0 )
+               bits |= 1ull << ( c - c0 );
+         h = mix( h ^ bits );
+      }
+   }
+   return h;
+}
+
+void FieldOps::placements( const Field& field, const Piece& piece, int32_t spawnX, int32_t spawnY,
+      std::vector<Placement>& result )
+{
+   if ( width( field ) <= Board::MAX_WIDTH )
+      Board( field ).placements( piece, spawnX, spawnY, result );
+   else if ( width( field ) <= WideBoard::MAX_WIDTH )
+      WideBoard( field ).placements( piece, spawnX, spawnY, result );
+   else
+      HugeBoard( field ).placements( piece, spawnX, spawnY, result );
+}
+
+bool FieldOps::reachable( const Field& field, const Piece& piece, int32_t spawnX, int32_t spawnY,
+      Placement& placement )
+{
+   auto nshapes = int32_t( piece.shapes.size() );
+   auto rot = placement.rotation;
+   if ( rot < 0 || rot >= nshapes )
+      return false;
+   // The same turns and moves as BasicBoard::placements.
+   auto turns = rot <= nshapes / 2 ? rot : rot - nshapes;
+   for ( int32_t t = 1; t <= std::abs( turns ); ++t ) {
+      auto s = ( turns > 0 ? t : nshapes - t ) % nshapes;
+      if ( !fits( field, piece.shapes[s], spawnX, spawnY ))
+         return false;
+   }
+   const auto& shape = piece.shapes[rot];
+   auto dir = placement.x < spawnX ? -1 : 1;
+   for ( auto x = spawnX; x != placement.x + dir; x += dir )
+      if ( !fits( field, shape, x, spawnY ))
+         return false;
+   placement.y = dropRow( field, shape, placement.x, spawnY );
+   return true;
+}
+
+bool Searcher::shouldStop()
+{
+   if ( mAborted.load( std::memory_order_relaxed ))
+      return true;
+   if ( clock::now() >= mDeadline || ( mpMonitor != nullptr && mpMonitor->inputPending() )) {
+      mAborted = true;
+      return true;
+   }
+   return false;
+}
+
+double placementScore( const Weights& weights, int32_t height, const Shape& shape, int32_t y,
+      int32_t eroded )
+{
+   int32_t minR = shape.size(), maxR = 0;
+   for ( const auto& pt : shape.coords ) {
+      minR = std::min( minR, pt.r );
+      maxR = std::max( maxR, pt.r );
+   }
+   double landing = height - y - ( minR + maxR ) / 2.0;
+   return weights.landingHeight * landing + weights.erodedCells * eroded;
+}
+
+Searcher::~Searcher()
+{
+}
+
+// Find the node in the tree of this search or in the retained tree, or
+// evaluate the placements and add a new node to the tree. The node holds at
+// least the best keep placements. A node that keeps fewer placements is
+// replaced by a new one that takes over its children, so only the missing
+// placements are evaluated.
+template<typename B>
+std::shared_ptr<const SearchNode> Searcher::node( B& board, const Piece& piece,
+      int32_t spawnX, int32_t spawnY, size_t keep, NodeMap& tree, SearchStats& stats )
+{
+   auto key = nodeKey( board, piece, spawnX, spawnY );
+   const SearchNode* pknown = nullptr;
+   auto it = tree.find( key );
+   if ( it != tree.end() ) {
+      if ( it->second->keeps( keep ))
+         return it->second;
+      pknown = it->second.get();
+   }
+   else {
+      it = mRetained.find( key );
+      if ( it != mRetained.end() ) {
+         ++stats.reused;
+         if ( it->second->keeps( keep )) {
+            tree[key] = it->second;
+            return it->second;
+         }
+         pknown = it->second.get();
+      }
+   }
+
+   auto pnode = evaluate( board, piece, spawnX, spawnY, keep, pknown, stats );
+   tree[key] = pnode;
+   return pnode;
+}
+
+// The evaluation cascade. The cheap stages give an upper bound of the full
+// evaluation of a placement that clears no rows, see boardBound; the bound
+// holds only for weights that punish the features, otherwise all placements
+// are evaluated. A placement is fully evaluated only if its bound is above
+// the worst of the best keep full evaluations so far. The placements are
+// tried in the order of the landing bound, so the first one that fails it
+// ends the loop. The children of pknown, a node of the same position, are
+// copied instead of evaluated again.
+template<typename B>
+std::shared_ptr<const SearchNode> Searcher::evaluate( B& board, const Piece& piece,
+      int32_t spawnX, int32_t spawnY, size_t keep, const SearchNode* pknown, SearchStats& stats )
+{
+   struct Candidate
+   {
+      Placement placement;
+      double bound;
+      size_t index;
+   };
+   // The scratch space is reused by the nodes that the thread evaluates.
+   thread_local typename B::FeatureProfile profile;
+   thread_local std::vector<Candidate> candidates;
+   thread_local std::vector<std::pair<size_t, Child>> evaluated;
+   thread_local std::vector<double> kept;
+
+   std::vector<Placement> pls;
+   board.placements( piece, spawnX, spawnY, pls );
+   stats.placements += pls.size();
+
+   const double UNBOUNDED = std::numeric_limits<double>::max();
+   bool staged = ( mStages & STAGE_LANDING ) && keep > 0 && keep < pls.size() && mWeights.rowTransitions <= 0
+      && mWeights.columnTransitions <= 0 && mWeights.holes <= 0 && mWeights.wells <= 0;
+   auto pnode = std::make_shared<SearchNode>();
+   pnode->candidates = pls.size();
+   pnode->keep = staged ? keep : 0;
+   auto& children = pnode->children;
+
+   FieldFeatures features;
+   if ( staged )
+      features = board.features( &profile );
+   candidates.clear();
+   for ( const auto& pl : pls ) {
+      const auto& shape = piece.shapes[pl.rotation];
+      double bound = UNBOUNDED;
+      if ( staged && !board.fillsRow( shape, pl.y ))
+         bound = std::min( UNBOUNDED, placementScore( mWeights, board.height(), shape, pl.y, 0 )
+            + boardBound( mWeights, board, features, profile, shape, pl.x, pl.y ));
+      candidates.push_back( Candidate{ pl, bound, candidates.size() } );
+   }
+   if ( staged ) {
+      std::sort( ITALL( candidates ), []( const Candidate& a, const Candidate& b ) {
+            return a.bound > b.bound || ( a.bound == b.bound && a.index < b.index );
+         });
+   }
+
+   // The best keep full evaluations, the worst of them on top.
+   kept.clear();
+   auto worseFirst = []( double a, double b ) { return a > b; };
+   auto cannotReach = [&]( double bound ) {
+      return staged && kept.size() >= keep && bound < kept.front();
+   };
+   auto known = [&]( const Placement& pl ) -> const Child* {
+      if ( pknown != nullptr )
+         for ( const auto& ch : pknown->children )
+            if ( ch.placement.rotation == pl.rotation && ch.placement.x == pl.x )
+               return &ch;
+      return nullptr;
+   };
+   evaluated.clear();
+   for ( size_t i = 0; i < candidates.size(); ++i ) {
+      const auto& cand = candidates[i];
+      const auto& shape = piece.shapes[cand.placement.rotation];
+      if ( cannotReach( cand.bound )) {
+         stats.rejected += candidates.size() - i;
+         break;
+      }
+      auto pknownChild = known( cand.placement );
+      if ( pknownChild == nullptr && staged && ( mStages & STAGE_HOLES ) && cand.bound != UNBOUNDED ) {
+         auto holes = board.holesAfter( shape, cand.placement.x, cand.placement.y );
+         if ( holes >= 0 ) {
+            auto bound = cand.bound + mWeights.holes * ( holes - board.holes() );
+            if ( cannotReach( bound )) {
+               ++stats.rejected;
+               continue;
+            }
+         }
+      }
+
+      Child ch{ cand.placement, 0, 0 };
+      if ( pknownChild != nullptr )
+         ch = *pknownChild;
+      else {
+         ++stats.evaluations;
+         auto eroded = board.place( piece, cand.placement );
+         ch.moveScore = placementScore( mWeights, board.height(), shape, cand.placement.y, eroded );
+         ch.boardScore = boardScore( mWeights, board );
+         board.undo();
+      }
+      evaluated.emplace_back( cand.index, ch );
+
+      if ( staged ) {
+         kept.push_back( ch.moveScore + ch.boardScore );
+         std::push_heap( ITALL( kept ), worseFirst );
+         if ( kept.size() > keep ) {
+            std::pop_heap( ITALL( kept ), worseFirst );
+            kept.pop_back();
+         }
+      }
+   }
+   // The equal scores stay in the order of the placements.
+   std::sort( ITALL( evaluated ), []( const std::pair<size_t, Child>& a, const std::pair<size_t, Child>& b ) {
+         return byImmediateScore( a.second, b.second )
+            || ( !byImmediateScore( b.second, a.second ) && a.first < b.first );
+      });
+   children.reserve( evaluated.size() );
+   for ( const auto& e : evaluated )
+      children.push_back( e.second );
+   return pnode;
+}
+
+template<typename B>
+double Searcher::expand( B& board, int32_t ply, const std::vector<const Piece*>& sequence,
+      const SearchEffort& effort, int32_t spawnY, NodeMap& tree, SearchStats& stats )
+{
+   if ( ply < int32_t( sequence.size() ))
+      return bestChild( board, *sequence[ply], ply, sequence, effort, spawnY, tree, stats );
+
+   // The piece is not known yet; every piece is equally likely.
+   double total = 0;
+   for ( auto ppiece : mAllPieces )
+      total += bestChild( board, *ppiece, ply, sequence, effort, spawnY, tree, stats );
+   return total / mAllPieces.size();
+}
+
+template<typename B>
+double Searcher::bestChild( B& board, const Piece& piece, int32_t ply,
+      const std::vector<const Piece*>& sequence, const SearchEffort& effort, int32_t spawnY,
+      NodeMap& tree, SearchStats& stats )
+{
+   if ( shouldStop() )
+      return LOST_SCORE;
+
+   ++stats.nodes;
+   auto spawnX = ( board.width() - piece.size ) / 2;
+   bool leaf = ply + 1 >= effort.depth;
+   auto pnode = node( board, piece, spawnX, spawnY, leaf ? 1 : effort.beamWidth, tree, stats );
+   const auto& children = pnode->children;
+   if ( children.empty() )
+      return LOST_SCORE;
+
+   // The children are sorted, the first has the best immediate score.
+   if ( leaf )
+      return children[0].moveScore + children[0].boardScore;
+
+   double best = std::numeric_limits<double>::lowest();
+   size_t beam = effort.beamWidth > 0 ? std::min<size_t>( effort.beamWidth, children.size() ) : children.size();
+   stats.pruned += pnode->candidates - beam;
+   for ( size_t i = 0; i < beam; ++i ) {
+      const auto& ch = children[i];
+      board.place( piece, ch.placement );
+      best = std::max( best, ch.moveScore + expand( board, ply + 1, sequence, effort, spawnY, tree, stats ));
+      board.undo();
+   }
+   return best;
+}
+
+Searcher::Result Searcher::search( const Field& field, const Settings& settings, const Round& round,
+      const SearchEffort& effort )
+{
+   Result result;
+   mDeadline = clock::now() + std::chrono::milliseconds( effort.timeBudget );
+   mAborted = false;
+
+   mAllPieces.clear();
+   for ( const auto& p : settings.pieces )
+      mAllPieces.push_back( p.second.get() );
+
+   auto pthis = settings.pieces.find( round.thisPiece );
+   if ( pthis == settings.pieces.end() || FieldOps::height( field ) == 0 )
+      return result;
+   std::vector<const Piece*> sequence{ pthis->second.get() };
+   auto pnext = settings.pieces.find( round.nextPiece );
+   if ( pnext != settings.pieces.end() )
+      sequence.push_back( pnext->second.get() );
+
+   switch ( settings.boardType ) {
+   case BOARD_STANDARD:
+      searchOn<StandardBoard>( field, sequence, round, effort, result );
+      break;
+   case BOARD_NARROW:
+      searchOn<Board>( field, sequence, round, effort, result );
+      break;
+   case BOARD_WIDE:
+      searchOn<WideBoard>( field, sequence, round, effort, result );
+      break;
+   case BOARD_HUGE:
+      searchOn<HugeBoard>( field, sequence, round, effort, result );
+      break;
+   case BOARD_NONE:
+      break;
+   }
+   return result;
+}
+
+template<typename B>
+void Searcher::searchOn( const Field& field, const std::vector<const Piece*>& sequence, const Round& round,
+      const SearchEffort& effort, Result& result )
+{
+   // The retained tree is only useful when the position is the one that was
+   // predicted; garbage or a solid row change the field and the tree is
+   // dropped.
+   const auto& piece = *sequence[0];
+   B root( field );
+   if ( mRetained.count( nodeKey( root, piece, round.pieceX, round.pieceY )) == 0 )
+      mRetained.clear();
+
+   NodeMap rootTree;
+   result.stats.nodes = 1;
+   auto proot = node( root, piece, round.pieceX, round.pieceY, effort.depth > 1 ? effort.beamWidth : 1,
+         rootTree, result.stats );
+   const auto& children = proot->children;
+   if ( children.empty() ) {
+      mRetained.clear();
+      return;
+   }
+
+   // Depth 1 is always complete.
+   result.found = true;
+   result.placement = children[0].placement;
+   result.score = children[0].moveScore + children[0].boardScore;
+   result.depthReached = 1;
+
+   size_t beam = effort.beamWidth > 0 ? std::min<size_t>( effort.beamWidth, children.size() ) : children.size();
+   std::vector<double> values( beam );
+   std::vector<SearchStats> taskStats( beam );
+   // Every root child has its own tree, so the tasks need no locking, and the
+   // tree of the chosen child is kept for the next round.
+   std::vector<NodeMap> taskTrees( beam );
+   size_t chosen = 0;
+   if ( effort.depth > 1 )
+      result.stats.pruned = proot->candidates - beam;
+   for ( int32_t depth = 2; depth <= effort.depth; ++depth ) {
+      TRACE_SPAN( "iteration", "depth", depth );
+      SearchEffort iteration = effort;
+      iteration.depth = depth;
+      mPool.parallelFor( beam, std::max( 1, effort.threads ), [&]( size_t i ) {
+            TRACE_SPAN( "task", "child", i );
+            taskStats[i] = SearchStats();
+            B board( root );
+            board.place( piece, children[i].placement );
+            values[i] = children[i].moveScore
+               + expand( board, 1, sequence, iteration, round.pieceY, taskTrees[i], taskStats[i] );
+         });
+      for ( const auto& ts : taskStats )
+         result.stats.addWork( ts );
+      if ( mAborted )
+         break;
+
+      chosen = std::max_element( ITALL( values )) - values.begin();
+      result.placement = children[chosen].placement;
+      result.score = values[chosen];
+      result.depthReached = depth;
+   }
+
+   if ( result.depthReached > 1 )
+      mRetained = std::move( taskTrees[chosen] );
+   else
+      mRetained.clear();
+}
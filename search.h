@@ -0,0 +1,207 @@
+/**
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#pragma once
+
+#include "game.h"
+#include "threadpool.h"
+#include "stats.h"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+// A placement of a piece: the shape (number of right turns) and the position
+// of the top-left corner of the shape after it was dropped.
+struct Placement
+{
+   int32_t rotation = 0;
+   int32_t x = 0;
+   int32_t y = 0;
+};
+
+// How much work to put into a move; see EffortController.
+struct SearchEffort
+{
+   int32_t depth = 1;      // number of pieces placed in a line of play
+   int32_t beamWidth = 0;  // children expanded below the root, 0 for all
+   int32_t threads = 1;
+   int32_t timeBudget = 0; // ms
+};
+
+// Weights of the features of a position (Dellacherie/El-Tetris).
+struct Weights
+{
+   double landingHeight = -4.500158825082766;
+   double erodedCells = 3.4181268101392694;
+   double rowTransitions = -3.2178882868487753;
+   double columnTransitions = -9.348695305445199;
+   double holes = -7.899265427351652;
+   double wells = -3.3855972247263626;
+};
+
+// The cheap stages of the evaluation of a placement. Each stage gives an
+// upper bound of the full evaluation and a placement whose bound can not reach
+// the placements that the search keeps is not evaluated further.
+enum EvalStage
+{
+   STAGE_LANDING = 1, // landing height and the rows and columns it leaves alone
+   STAGE_HOLES = 2,   // and the holes covered by the bottom of the shape
+   STAGES_NONE = 0,
+   STAGES_ALL = STAGE_LANDING | STAGE_HOLES
+};
+
+struct FieldFeatures
+{
+   int32_t maxHeight = 0;
+   int32_t holes = 0;
+   int32_t rowTransitions = 0;
+   int32_t columnTransitions = 0;
+   int32_t wells = 0;
+};
+
+// The score of a move: the landing height of the shape locked at row y and
+// the eroded cells (FieldOps::place).
+double placementScore( const Weights& weights, int32_t height, const Shape& shape, int32_t y,
+      int32_t eroded );
+
+// The score of a position from its features.
+inline double featureScore( const Weights& weights, const FieldFeatures& f )
+{
+   return weights.rowTransitions * f.rowTransitions + weights.columnTransitions * f.columnTransitions
+      + weights.holes * f.holes + weights.wells * f.wells;
+}
+
+// Operations on Field used by the search. Every non-zero cell is occupied.
+// They work only on the playable rows of the field; the solid rows below them
+// can not change and do not affect the evaluation.
+struct FieldOps
+{
+   static int32_t width( const Field& field )
+   {
+      return field.rows.empty() ? 0 : field.rows[0].size();
+   }
+
+   static int32_t height( const Field& field )
+   {
+      return field.rows.size();
+   }
+
+   static bool fits( const Field& field, const Shape& shape, int32_t x, int32_t y );
+
+   // The row where the shape stops when it is dropped from y.
+   static int32_t dropRow( const Field& field, const Shape& shape, int32_t x, int32_t y );
+
+   // Lock the shape into the field and remove the full rows. Returns the
+   // number of cells of the shape that were removed with the rows times the
+   // number of removed rows.
+   static int32_t place( Field& field, const Shape& shape, int32_t x, int32_t y, int32_t& cleared );
+
+   static FieldFeatures features( const Field& field );
+
+   // A hash of the occupied cells and the size of the playable field.
+   static uint64_t hash( const Field& field );
+
+   // Find the placements reachable by turning at the spawn position, moving
+   // sideways and dropping.
+   static void placements( const Field& field, const Piece& piece, int32_t spawnX, int32_t spawnY,
+         std::vector<Placement>& result );
+
+   // Whether placements() finds the rotation and column of placement; if so
+   // its row is set.
+   static bool reachable( const Field& field, const Piece& piece, int32_t spawnX, int32_t spawnY,
+         Placement& placement );
+};
+
+struct SearchNode;
+
+// The search keeps the nodes it created for the chosen move. When the next
+// round starts from the predicted position, the search reuses them and only
+// evaluates the positions and the placements that it has not seen yet.
+class Searcher
+{
+public:
+   using clock = std::chrono::steady_clock;
+
+   struct Result
+   {
+      bool found = false;
+      Placement placement;
+      double score = 0;
+      int32_t depthReached = 0;
+      SearchStats stats;
+   };
+
+private:
+   // The nodes are keyed by the position, the piece and its spawn position.
+   using NodeMap = std::unordered_map<uint64_t, std::shared_ptr<const SearchNode>>;
+
+   ThreadPool& mPool;
+   Weights mWeights;
+   std::vector<const Piece*> mAllPieces;
+   clock::time_point mDeadline;
+   const InputMonitor* mpMonitor = nullptr;
+   std::atomic<bool> mAborted{ false };
+   NodeMap mRetained; // read-only while searching
+   int32_t mStages = STAGES_ALL;
+
+   bool shouldStop();
+
+   // The search is instantiated for every board type in search.cpp.
+   template<typename B>
+   std::shared_ptr<const SearchNode> node( B& board, const Piece& piece,
+         int32_t spawnX, int32_t spawnY, size_t keep, NodeMap& tree, SearchStats& stats );
+   template<typename B>
+   std::shared_ptr<const SearchNode> evaluate( B& board, const Piece& piece,
+         int32_t spawnX, int32_t spawnY, size_t keep, const SearchNode* pknown, SearchStats& stats );
+   template<typename B>
+   double expand( B& board, int32_t ply, const std::vector<const Piece*>& sequence,
+         const SearchEffort& effort, int32_t spawnY, NodeMap& tree, SearchStats& stats );
+   template<typename B>
+   double bestChild( B& board, const Piece& piece, int32_t ply,
+         const std::vector<const Piece*>& sequence, const SearchEffort& effort, int32_t spawnY,
+         NodeMap& tree, SearchStats& stats );
+   template<typename B>
+   void searchOn( const Field& field, const std::vector<const Piece*>& sequence, const Round& round,
+         const SearchEffort& effort, Result& result );
+
+public:
+   Searcher( ThreadPool& pool, const Weights& weights = Weights() )
+      : mPool( pool ), mWeights( weights )
+   { }
+   ~Searcher();
+
+   void setInputMonitor( const InputMonitor* pmonitor )
+   {
+      mpMonitor = pmonitor;
+   }
+
+   // The cheap stages of the evaluation, a combination of EvalStage.
+   // STAGE_HOLES is used only together with STAGE_LANDING.
+   void setStages( int32_t stages )
+   {
+      mStages = stages;
+   }
+
+   // Iterative deepening up to effort.depth. The result of the deepest
+   // completed iteration is returned when the time budget runs out or new
+   // input arrives.
+   Result search( const Field& field, const Settings& settings, const Round& round,
+         const SearchEffort& effort );
+};
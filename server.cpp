@@ -0,0 +1,274 @@
+/**
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+#include "server.h"
+#include "blockbot.h"
+#include "myai.h"
+#include "pieces.h"
+
+#include <deque>
+#include <mutex>
+#include <sstream>
+
+#include <errno.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "defines.h"
+
+// One game on one connection. The lines are queued by the server thread and
+// handled by at most one pool thread at a time, so the game itself needs no
+// locking.
+class GameSession: public InputMonitor, public std::enable_shared_from_this<GameSession>
+{
+   int mFd;
+   std::ostringstream mOutput;
+   ActionWriter mWriter;
+   std::shared_ptr<TheGame> mpGame;
+   BlockBot mBot;
+   std::shared_ptr<MyAi> mpAi;
+
+   std::string mPartial; // server thread only
+   mutable std::mutex mMutex;
+   std::deque<std::string> mLines;
+   bool mBusy = false;
+
+   void handleLines()
+   {
+      std::string line, command, rest;
+      while ( true ) {
+         {
+            std::lock_guard<std::mutex> lock( mMutex );
+            if ( mLines.empty() ) {
+               mBusy = false;
+               return;
+            }
+            line.swap( mLines.front() );
+            mLines.pop_front();
+         }
+
+         std::stringstream ss( line );
+         if ( !( ss >> command ))
+            continue;
+         std::getline( ss, rest );
+         mBot.handle( command, rest );
+         flush();
+      }
+   }
+
+   void flush()
+   {
+      std::string out = mOutput.str();
+      if ( out.empty() )
+         return;
+      mOutput.str( "" );
+
+      size_t sent = 0;
+      while ( sent < out.size() ) {
+         auto n = ::send( mFd, out.data() + sent, out.size() - sent, MSG_NOSIGNAL );
+         if ( n < 0 && errno == EINTR )
+            continue;
+         if ( n <= 0 ) {
+            DBGERR( "Game " << mFd << ": send failed: " << strerror( errno ) << "\n" );
+            return;
+         }
+         sent += n;
+      }
+   }
+
+public:
+   GameSession( int fd, std::shared_ptr<ThreadPool> ppool, std::shared_ptr<const OpeningBook> pbook,
+         const Settings& pieces, int32_t evalStages )
+      : mFd( fd ), mWriter( mOutput ), mpGame( std::make_shared<TheGame>() ), mBot( mpGame )
+   {
+      mpGame->mpSettings->pieces = pieces.pieces;
+      mpAi = std::make_shared<MyAi>( mWriter, ppool );
+      mpAi->setEvalStages( evalStages );
+      if ( pbook != nullptr )
+         mpAi->setOpeningBook( pbook );
+      mpAi->setInputMonitor( this );
+      mBot.setAi( mpAi );
+   }
+
+   ~GameSession()
+   {
+      ::close( mFd );
+   }
+
+   // Split the data into lines and queue them. Returns true when the lines
+   // have to be scheduled for handling.
+   bool receive( const char* data, size_t size, bool end )
+   {
+      std::lock_guard<std::mutex> lock( mMutex );
+      size_t queued = mLines.size();
+      for ( size_t i = 0; i < size; ++i ) {
+         if ( data[i] == '\n' ) {
+            mLines.push_back( std::move( mPartial ));
+            mPartial.clear();
+         }
+         else
+            mPartial += data[i];
+      }
+      if ( end && !mPartial.empty() ) {
+         mLines.push_back( std::move( mPartial ));
+         mPartial.clear();
+      }
+
+      if ( mBusy || mLines.size() == queued )
+         return false;
+      mBusy = true;
+      return true;
+   }
+
+   void schedule( ThreadPool& pool )
+   {
+      auto pself = shared_from_this();
+      pool.submit( [pself]() { pself->handleLines(); } );
+   }
+
+   bool inputPending() const override
+   {
+      std::lock_guard<std::mutex> lock( mMutex );
+      return !mLines.empty();
+   }
+};
+
+GameServer::GameServer( std::shared_ptr<ThreadPool> ppool, std::shared_ptr<const OpeningBook> pbook )
+   : mpPool( ppool ), mpBook( pbook ), mpPieces( std::make_shared<Settings>() )
+{
+   loadStandardPieces( mpPieces );
+}
+
+GameServer::~GameServer()
+{
+   // The sessions still queued in the pool close their sockets when they
+   // finish.
+   mSessions.clear();
+   if ( mEpollFd >= 0 )
+      ::close( mEpollFd );
+   if ( mListenFd >= 0 ) {
+      ::close( mListenFd );
+      ::unlink( mPath.c_str() );
+   }
+}
+
+bool GameServer::listen( const std::string& path )
+{
+   sockaddr_un addr;
+   memset( &addr, 0, sizeof( addr ));
+   addr.sun_family = AF_UNIX;
+   if ( path.size() >= sizeof( addr.sun_path )) {
+      DBGERR( "Socket path too long: " << path << "\n" );
+      return false;
+   }
+   strcpy( addr.sun_path, path.c_str() );
+
+   mListenFd = ::socket( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0 );
+   if ( mListenFd < 0 ) {
+      DBGERR( "socket: " << strerror( errno ) << "\n" );
+      return false;
+   }
+   ::unlink( path.c_str() );
+   if ( ::bind( mListenFd, (sockaddr*) &addr, sizeof( addr )) < 0
+         || ::listen( mListenFd, SOMAXCONN ) < 0 ) {
+      DBGERR( "Can not listen on " << path << ": " << strerror( errno ) << "\n" );
+      return false;
+   }
+   mPath = path;
+
+   mEpollFd = ::epoll_create1( EPOLL_CLOEXEC );
+   if ( mEpollFd < 0 ) {
+      DBGERR( "epoll_create1: " << strerror( errno ) << "\n" );
+      return false;
+   }
+   epoll_event ev;
+   ev.events = EPOLLIN;
+   ev.data.fd = mListenFd;
+   if ( ::epoll_ctl( mEpollFd, EPOLL_CTL_ADD, mListenFd, &ev ) < 0 ) {
+      DBGERR( "epoll_ctl: " << strerror( errno ) << "\n" );
+      return false;
+   }
+   return true;
+}
+
+void GameServer::accept()
+{
+   int fd = ::accept4( mListenFd, nullptr, nullptr, SOCK_CLOEXEC );
+   if ( fd < 0 ) {
+      DBGERR( "accept: " << strerror( errno ) << "\n" );
+      return;
+   }
+
+   epoll_event ev;
+   ev.events = EPOLLIN;
+   ev.data.fd = fd;
+   if ( ::epoll_ctl( mEpollFd, EPOLL_CTL_ADD, fd, &ev ) < 0 ) {
+      DBGERR( "epoll_ctl: " << strerror( errno ) << "\n" );
+      ::close( fd );
+      return;
+   }
+   mSessions[fd] = std::make_shared<GameSession>( fd, mpPool, mpBook, *mpPieces, mEvalStages );
+}
+
+void GameServer::receive( int fd )
+{
+   auto it = mSessions.find( fd );
+   if ( it == mSessions.end() )
+      return;
+
+   char buffer[16384];
+   auto n = ::read( fd, buffer, sizeof( buffer ));
+   if ( n < 0 && errno == EINTR )
+      return;
+   bool end = n <= 0;
+   auto psession = it->second;
+   if ( psession->receive( buffer, end ? 0 : n, end ))
+      psession->schedule( *mpPool );
+   if ( end )
+      close( fd );
+}
+
+// Stop watching the connection. The session closes the socket when the pool
+// has handled the remaining lines.
+void GameServer::close( int fd )
+{
+   ::epoll_ctl( mEpollFd, EPOLL_CTL_DEL, fd, nullptr );
+   mSessions.erase( fd );
+}
+
+bool GameServer::run()
+{
+   const int MAX_EVENTS = 64;
+   epoll_event events[MAX_EVENTS];
+   while ( true ) {
+      int n = ::epoll_wait( mEpollFd, events, MAX_EVENTS, -1 );
+      if ( n < 0 ) {
+         if ( errno == EINTR )
+            continue;
+         DBGERR( "epoll_wait: " << strerror( errno ) << "\n" );
+         return false;
+      }
+      for ( int i = 0; i < n; ++i ) {
+         if ( events[i].data.fd == mListenFd )
+            accept();
+         else
+            receive( events[i].data.fd );
+      }
+   }
+}
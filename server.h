@@ -0,0 +1,69 @@
+/**
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+#pragma once
+
+#include "game.h"
+#include "book.h"
+#include "threadpool.h"
+#include "search.h"
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+class GameSession;
+
+// Hosts many independent games in one process. Every connection to a Unix
+// socket is one game that speaks the normal text protocol. A single thread
+// reads the sockets with epoll and hands the complete lines of a game to the
+// shared thread pool, which handles them in order and writes the answers back
+// to the socket. The pieces, the opening book and the pool are shared by all
+// the games.
+class GameServer
+{
+   std::shared_ptr<ThreadPool> mpPool;
+   std::shared_ptr<const OpeningBook> mpBook;
+   std::shared_ptr<Settings> mpPieces;
+   std::unordered_map<int, std::shared_ptr<GameSession>> mSessions;
+   std::string mPath;
+   int32_t mEvalStages = STAGES_ALL;
+   int mListenFd = -1;
+   int mEpollFd = -1;
+
+   void accept();
+   void receive( int fd );
+   void close( int fd );
+
+public:
+   GameServer( std::shared_ptr<ThreadPool> ppool, std::shared_ptr<const OpeningBook> pbook );
+   ~GameServer();
+
+   GameServer( const GameServer& ) = delete;
+   GameServer& operator=( const GameServer& ) = delete;
+
+   // The cheap evaluation stages of the games that connect later.
+   void setEvalStages( int32_t stages )
+   {
+      mEvalStages = stages;
+   }
+
+   // Create the socket at path, replacing an old one.
+   bool listen( const std::string& path );
+
+   // Serve the games until an error occurs.
+   bool run();
+};
@@ -0,0 +1,76 @@
+/**
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <array>
+#include <cstddef>
+
+// A bounded lock-free queue for exactly one producer and one consumer thread.
+//
+// The slots are constructed once and reused. The producer fills a slot in
+// place (claim/publish) and the consumer reads it in place (front/pop) so
+// that objects with their own buffers (eg. std::string) keep their capacity
+// and the steady state does not allocate.
+template<typename T, size_t Capacity>
+class SpscRing
+{
+   static_assert( Capacity > 1 && ( Capacity & ( Capacity - 1 )) == 0,
+         "Capacity must be a power of 2" );
+
+   std::array<T, Capacity> mSlots;
+   alignas(64) std::atomic<size_t> mHead{ 0 }; // next slot to read
+   alignas(64) std::atomic<size_t> mTail{ 0 }; // next slot to write
+
+public:
+   // Producer: returns the slot to fill or nullptr if the ring is full.
+   T* claim()
+   {
+      auto tail = mTail.load( std::memory_order_relaxed );
+      if ( tail - mHead.load( std::memory_order_acquire ) >= Capacity )
+         return nullptr;
+      return &mSlots[tail & ( Capacity - 1 )];
+   }
+
+   // Producer: makes the claimed slot visible to the consumer.
+   void publish()
+   {
+      mTail.store( mTail.load( std::memory_order_relaxed ) + 1, std::memory_order_release );
+   }
+
+   // Consumer: returns the oldest slot or nullptr if the ring is empty.
+   T* front()
+   {
+      auto head = mHead.load( std::memory_order_relaxed );
+      if ( head == mTail.load( std::memory_order_acquire ))
+         return nullptr;
+      return &mSlots[head & ( Capacity - 1 )];
+   }
+
+   // Consumer: releases the slot returned by front().
+   void pop()
+   {
+      mHead.store( mHead.load( std::memory_order_relaxed ) + 1, std::memory_order_release );
+   }
+
+   // Any thread: a cheap, possibly stale, check.
+   bool empty() const
+   {
+      return mHead.load( std::memory_order_acquire ) == mTail.load( std::memory_order_acquire );
+   }
+};
@@ -0,0 +1,119 @@
+/**
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+
+// Counters of the work done by the AI. Every search thread counts into its
+// own instance and the instances are added when the threads are done.
+struct SearchStats
+{
+   int32_t moves = 0;
+   uint64_t nodes = 0;        // positions expanded
+   uint64_t placements = 0;   // placements enumerated
+   uint64_t evaluations = 0;  // placements fully evaluated
+   uint64_t rejected = 0;     // placements rejected by the cheap stages
+   uint64_t pruned = 0;       // children not expanded because of the beam
+   uint64_t reused = 0;       // nodes taken over from the previous search, whole or in part
+   uint64_t rollouts = 0;     // simulations of the Monte-Carlo search
+   uint64_t bookLookups = 0;
+   uint64_t bookHits = 0;
+   int64_t depthReached = 0;  // sum over moves
+   int64_t depthLimit = 0;    // sum over moves
+   double timeUsed = 0;       // ms
+   double timeBudget = 0;     // ms
+
+   void add( const SearchStats& other )
+   {
+      moves += other.moves;
+      nodes += other.nodes;
+      placements += other.placements;
+      evaluations += other.evaluations;
+      rejected += other.rejected;
+      pruned += other.pruned;
+      reused += other.reused;
+      rollouts += other.rollouts;
+      bookLookups += other.bookLookups;
+      bookHits += other.bookHits;
+      depthReached += other.depthReached;
+      depthLimit += other.depthLimit;
+      timeUsed += other.timeUsed;
+      timeBudget += other.timeBudget;
+   }
+
+   // Counters of the search itself, without moves, book and time.
+   void addWork( const SearchStats& other )
+   {
+      nodes += other.nodes;
+      placements += other.placements;
+      evaluations += other.evaluations;
+      rejected += other.rejected;
+      pruned += other.pruned;
+      reused += other.reused;
+      rollouts += other.rollouts;
+   }
+
+   static double ratio( double a, double b )
+   {
+      return b > 0 ? a / b : 0;
+   }
+
+   double nodesPerSecond() const
+   {
+      return ratio( nodes * 1000.0, timeUsed );
+   }
+
+   // Human readable report.
+   void write( std::ostream& out ) const
+   {
+      out << "moves: " << moves << "\n";
+      out << "nodes: " << nodes << ", placements: " << placements
+         << ", evaluations: " << evaluations << "\n";
+      out << "nodes/s: " << uint64_t( nodesPerSecond() ) << "\n";
+      out << "depth reached/limit: " << ratio( depthReached, moves ) << "/" << ratio( depthLimit, moves ) << "\n";
+      out << "book hit rate: " << bookHits << "/" << bookLookups
+         << " (" << 100 * ratio( bookHits, bookLookups ) << "%)\n";
+      out << "rejected by cheap stages: " << rejected << " (" << 100 * ratio( rejected, placements )
+         << "% of placements)\n";
+      out << "reused nodes: " << reused << " (" << 100 * ratio( reused, nodes ) << "% of nodes)\n";
+      out << "rollouts: " << rollouts << "\n";
+      out << "pruned by beam: " << pruned << " (" << 100 * ratio( pruned, placements ) << "% of placements)\n";
+      out << "time used/budget: " << timeUsed << "/" << timeBudget << " ms ("
+         << 100 * ratio( timeUsed, timeBudget ) << "%)\n";
+   }
+
+   // One line of key=value pairs.
+   void writeLine( std::ostream& out, int32_t round ) const
+   {
+      out << "stats round=" << round
+         << " book=" << bookHits
+         << " depth=" << depthReached << "/" << depthLimit
+         << " nodes=" << nodes
+         << " placements=" << placements
+         << " evals=" << evaluations
+         << " rejected=" << rejected
+         << " pruned=" << pruned
+         << " reused=" << reused
+         << " rollouts=" << rollouts
+         << " nps=" << uint64_t( nodesPerSecond() )
+         << " time=" << timeUsed
+         << " budget=" << timeBudget
+         << "\n";
+   }
+};
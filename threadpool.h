@@ -0,0 +1,132 @@
+/**
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "trace.h"
+
+class ThreadPool
+{
+public:
+   using task_t = std::function<void()>;
+
+private:
+   std::vector<std::thread> mThreads;
+   std::deque<task_t> mTasks;
+   std::mutex mMutex;
+   std::condition_variable mWakeup;
+   bool mStopping = false;
+
+   void work()
+   {
+      Tracer::setThreadName( "worker" );
+      while ( true ) {
+         task_t task;
+         {
+            std::unique_lock<std::mutex> lock( mMutex );
+            mWakeup.wait( lock, [this]() { return mStopping || !mTasks.empty(); } );
+            if ( mTasks.empty() )
+               return;
+            task = std::move( mTasks.front() );
+            mTasks.pop_front();
+         }
+         task();
+      }
+   }
+
+public:
+   ThreadPool( size_t threads )
+   {
+      for ( size_t i = 0; i < threads; ++i )
+         mThreads.emplace_back( [this]() { work(); } );
+   }
+
+   ~ThreadPool()
+   {
+      {
+         std::lock_guard<std::mutex> lock( mMutex );
+         mStopping = true;
+      }
+      mWakeup.notify_all();
+      for ( auto& t : mThreads )
+         t.join();
+   }
+
+   ThreadPool( const ThreadPool& ) = delete;
+   ThreadPool& operator=( const ThreadPool& ) = delete;
+
+   size_t size() const
+   {
+      return mThreads.size();
+   }
+
+   void submit( task_t task )
+   {
+      {
+         std::lock_guard<std::mutex> lock( mMutex );
+         mTasks.push_back( std::move( task ));
+      }
+      mWakeup.notify_one();
+   }
+
+   // Call fn( i ) for every i in [0, count) on at most `threads` threads. The
+   // calling thread takes part in the work and only waits for the items that
+   // other threads have already started, so a task running in the pool may
+   // call parallelFor without the risk of a deadlock.
+   void parallelFor( size_t count, size_t threads, std::function<void( size_t )> fn )
+   {
+      struct Shared
+      {
+         std::atomic<size_t> next{ 0 };
+         std::atomic<size_t> done{ 0 };
+         std::mutex mutex;
+         std::condition_variable finished;
+      };
+
+      auto pshared = std::make_shared<Shared>();
+      auto run = [pshared, count, fn]() {
+         size_t i;
+         while ( ( i = pshared->next++ ) < count ) {
+            fn( i );
+            if ( ++pshared->done == count ) {
+               std::lock_guard<std::mutex> lock( pshared->mutex );
+               pshared->finished.notify_all();
+            }
+         }
+      };
+
+      if ( threads > count )
+         threads = count;
+      if ( threads > mThreads.size() + 1 )
+         threads = mThreads.size() + 1;
+      for ( size_t t = 1; t < threads; ++t )
+         submit( run );
+      run();
+
+      std::unique_lock<std::mutex> lock( pshared->mutex );
+      pshared->finished.wait( lock, [&]() { return pshared->done == count; } );
+   }
+};
@@ -0,0 +1,169 @@
+/**
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+// Generates the opening book. Starting from the empty field it runs a deep
+// search for every pair of the current and the next piece, plays the chosen
+// placement and repeats from the resulting positions for the requested
+// number of plies. Positions with a stack higher than the limit are not
+// expanded; they are rare in the opening and the bot searches them anyway.
+
+#include "../book.h"
+#include "../pieces.h"
+#include "../search.h"
+#include "../threadpool.h"
+
+#include <algorithm>
+#include <iostream>
+#include <set>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace {
+
+struct Position
+{
+   Field field;
+   char piece;
+};
+
+void usage()
+{
+   std::cerr <<
+      "Usage: bookgen [options] output-file\n"
+      "  -p N      plies from the empty field (default 3)\n"
+      "  -d N      search depth (default 3)\n"
+      "  -b N      beam width (default 10)\n"
+      "  -t MS     time limit for one search (default 2000)\n"
+      "  -m N      maximum stack height of a position in the book (default 6)\n"
+      "  -w N      field width (default 10)\n"
+      "  -h N      field height (default 20)\n"
+      "  -j N      threads (default: number of cores)\n";
+}
+
+} // namespace
+
+int main( int argc, char* argv[] )
+{
+   int32_t plies = 3;
+   int32_t maxHeight = 6;
+   int32_t width = 10;
+   int32_t height = 20;
+   int32_t threads = std::max( 1u, std::thread::hardware_concurrency() );
+   SearchEffort effort;
+   effort.depth = 3;
+   effort.beamWidth = 10;
+   effort.timeBudget = 2000;
+   std::string output;
+
+   for ( int i = 1; i < argc; ++i ) {
+      std::string arg = argv[i];
+      auto value = [&]() { return i + 1 < argc ? atoi( argv[++i] ) : 0; };
+      if ( arg == "-p" ) plies = value();
+      else if ( arg == "-d" ) effort.depth = value();
+      else if ( arg == "-b" ) effort.beamWidth = value();
+      else if ( arg == "-t" ) effort.timeBudget = value();
+      else if ( arg == "-m" ) maxHeight = value();
+      else if ( arg == "-w" ) width = value();
+      else if ( arg == "-h" ) height = value();
+      else if ( arg == "-j" ) threads = value();
+      else if ( arg.size() > 1 && arg[0] == '-' ) {
+         usage();
+         return 1;
+      }
+      else
+         output = arg;
+   }
+   if ( output.empty() || plies < 1 || effort.depth < 1 || threads < 1 || width < 1 || height < 1 ) {
+      usage();
+      return 1;
+   }
+   effort.threads = threads;
+
+   auto psettings = std::make_shared<Settings>();
+   psettings->fieldWidth = width;
+   psettings->fieldHeight = height;
+   if ( !chooseBoardType( *psettings )) {
+      std::cerr << "The field is wider than " << MAX_FIELD_WIDTH << " columns\n";
+      return 1;
+   }
+   loadStandardPieces( psettings );
+   std::vector<char> pieceIds;
+   for ( const auto& p : psettings->pieces )
+      pieceIds.push_back( p.first );
+   std::sort( ITALL( pieceIds ));
+
+   ThreadPool pool( threads - 1 );
+   Searcher searcher( pool );
+
+   Field empty;
+   empty.rows.assign( height, Field::row_t( width, 0 ));
+   std::vector<Position> frontier;
+   for ( auto id : pieceIds )
+      frontier.push_back( Position{ empty, id } );
+
+   std::vector<BookEntry> entries;
+   std::set<std::pair<uint64_t, char>> seen;
+   for ( int32_t ply = 0; ply < plies && !frontier.empty(); ++ply ) {
+      std::vector<Position> next;
+      size_t done = 0;
+      for ( const auto& pos : frontier ) {
+         const auto& piece = *psettings->pieces[pos.piece];
+         for ( auto nextId : pieceIds ) {
+            Round round;
+            round.thisPiece = pos.piece;
+            round.nextPiece = nextId;
+            round.pieceX = ( width - piece.size ) / 2;
+            round.pieceY = -1;
+            auto result = searcher.search( pos.field, *psettings, round, effort );
+            if ( !result.found )
+               continue;
+
+            BookEntry entry;
+            entry.hash = FieldOps::hash( pos.field );
+            entry.thisPiece = pos.piece;
+            entry.nextPiece = nextId;
+            entry.rotation = result.placement.rotation;
+            entry.x = result.placement.x;
+            entry.reserved = 0;
+            entries.push_back( entry );
+
+            Position child{ pos.field, nextId };
+            int32_t cleared;
+            FieldOps::place( child.field, piece.shapes[result.placement.rotation],
+                  result.placement.x, result.placement.y, cleared );
+            if ( FieldOps::features( child.field ).maxHeight > maxHeight )
+               continue;
+            if ( seen.insert( std::make_pair( FieldOps::hash( child.field ), nextId )).second )
+               next.push_back( child );
+         }
+         ++done;
+         std::cerr << "\rply " << ply + 1 << ": " << done << "/" << frontier.size()
+            << " positions, " << entries.size() << " entries" << std::flush;
+      }
+      std::cerr << "\n";
+      frontier.swap( next );
+   }
+
+   if ( !OpeningBook::write( output, width, height, entries )) {
+      std::cerr << "Failed to write " << output << "\n";
+      return 1;
+   }
+   std::cerr << "Wrote " << entries.size() << " entries to " << output << "\n";
+   return 0;
+}
@@ -0,0 +1,201 @@
+/**
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+// The rules of the game engine shared by the local tools: the scoring, the
+// garbage and solid rows and the field with the cell values of the text
+// protocol.
+
+#pragma once
+
+#include "../game.h"
+#include "../binproto.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+const int32_t GARBAGE_POINTS = 4;
+const int32_t SOLID_ROW_ROUNDS = 15;
+const int32_t PERFECT_CLEAR_POINTS = 18;
+const int32_t ROW_POINTS[] = { 0, 0, 3, 6, 10 };
+
+const int8_t CELL_EMPTY = 0;
+const int8_t CELL_SHAPE = 1;
+const int8_t CELL_BLOCK = 2;
+const int8_t CELL_SOLID = 3;
+
+// The row points for clearing rows with a combo of previous consecutive
+// clears; a perfect clear leaves no blocks in the field.
+inline int32_t clearPoints( int32_t cleared, int32_t combo, bool perfect )
+{
+   if ( cleared <= 0 )
+      return 0;
+   if ( perfect )
+      return PERFECT_CLEAR_POINTS;
+   return ROW_POINTS[std::min( cleared, 4 )] + combo;
+}
+
+class EngineField
+{
+   int32_t mWidth;
+   int32_t mHeight;
+   std::vector<int8_t> mCells;
+
+public:
+   EngineField( int32_t width, int32_t height )
+      : mWidth( width ), mHeight( height ), mCells( width * height, CELL_EMPTY )
+   { }
+
+   int32_t width() const
+   {
+      return mWidth;
+   }
+
+   int32_t height() const
+   {
+      return mHeight;
+   }
+
+   int8_t at( int32_t r, int32_t c ) const
+   {
+      return mCells[r * mWidth + c];
+   }
+
+   bool fits( const Shape& shape, int32_t x, int32_t y ) const
+   {
+      for ( const auto& pt : shape.coords ) {
+         auto r = y + pt.r;
+         auto c = x + pt.c;
+         if ( c < 0 || c >= mWidth || r >= mHeight )
+            return false;
+         if ( r >= 0 && at( r, c ) != CELL_EMPTY )
+            return false;
+      }
+      return true;
+   }
+
+   // Returns false if a part of the piece is above the field.
+   bool lock( const Shape& shape, int32_t x, int32_t y )
+   {
+      bool inside = true;
+      for ( const auto& pt : shape.coords ) {
+         auto r = y + pt.r;
+         if ( r < 0 )
+            inside = false;
+         else
+            mCells[r * mWidth + x + pt.c] = CELL_BLOCK;
+      }
+      return inside;
+   }
+
+   int32_t clearRows()
+   {
+      int32_t cleared = 0;
+      int32_t dst = mHeight - 1;
+      for ( int32_t src = mHeight - 1; src >= 0; --src ) {
+         bool full = true;
+         for ( int32_t c = 0; c < mWidth && full; ++c )
+            full = at( src, c ) == CELL_BLOCK;
+         if ( full ) {
+            ++cleared;
+            continue;
+         }
+         if ( dst != src )
+            std::copy( &mCells[src * mWidth], &mCells[src * mWidth] + mWidth, &mCells[dst * mWidth] );
+         --dst;
+      }
+      for ( ; dst >= 0; --dst )
+         std::fill( &mCells[dst * mWidth], &mCells[dst * mWidth] + mWidth, CELL_EMPTY );
+      return cleared;
+   }
+
+   bool hasBlocks() const
+   {
+      return std::find( mCells.begin(), mCells.end(), CELL_BLOCK ) != mCells.end();
+   }
+
+   // Push the rows above the solid rows up and insert a new row. Returns false
+   // if a non-empty row was pushed out of the field.
+   bool insertRow( int8_t value, int32_t hole )
+   {
+      bool ok = true;
+      for ( int32_t c = 0; c < mWidth; ++c )
+         if ( at( 0, c ) != CELL_EMPTY )
+            ok = false;
+
+      int32_t target = mHeight - 1;
+      if ( value != CELL_SOLID ) {
+         while ( target >= 0 && at( target, 0 ) == CELL_SOLID )
+            --target;
+      }
+      if ( target < 0 )
+         return false;
+      std::copy( mCells.begin() + mWidth, mCells.begin() + ( target + 1 ) * mWidth, mCells.begin() );
+      for ( int32_t c = 0; c < mWidth; ++c )
+         mCells[target * mWidth + c] = c == hole ? CELL_EMPTY : value;
+      return ok;
+   }
+
+   // The playable rows as bitmasks of the blocked cells; see binproto.h.
+   void encode( BinaryEncoder& out ) const
+   {
+      int32_t solid = 0;
+      while ( solid < mHeight && at( mHeight - 1 - solid, 0 ) == CELL_SOLID )
+         ++solid;
+      out.put8( solid );
+      out.put8( mHeight - solid );
+      for ( int32_t r = 0; r < mHeight - solid; ++r ) {
+         for ( int32_t word = 0; word < mWidth; word += 32 ) {
+            uint32_t bits = 0;
+            for ( int32_t c = word; c < std::min( word + 32, mWidth ); ++c )
+               if ( at( r, c ) != CELL_EMPTY )
+                  bits |= 1u << ( c - word );
+            out.put32( bits );
+         }
+      }
+   }
+
+   // Append the field in the format of the text protocol, with the cells of
+   // the shape at (x, y) if pshape is not null.
+   void write( std::string& out, const Shape* pshape, int32_t x, int32_t y ) const
+   {
+      auto start = out.size();
+      for ( int32_t r = 0; r < mHeight; ++r ) {
+         for ( int32_t c = 0; c < mWidth; ++c ) {
+            out += char( '0' + at( r, c ));
+            out += c + 1 < mWidth ? ',' : ';';
+         }
+      }
+      out.pop_back();
+      if ( pshape != nullptr ) {
+         for ( const auto& pt : pshape->coords ) {
+            auto r = y + pt.r;
+            if ( r >= 0 && r < mHeight )
+               out[start + 2 * ( r * mWidth + x + pt.c )] = char( '0' + CELL_SHAPE );
+         }
+      }
+   }
+
+   void write( std::ostream& out, const Shape* pshape, int32_t x, int32_t y ) const
+   {
+      std::string line;
+      write( line, pshape, x, y );
+      out << line;
+   }
+};
@@ -0,0 +1,392 @@
+/**
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+// Generates engine streams of any length for load testing and profiling the
+// parsers and BlockBot::run. The stream is a sequence of games, each with a
+// settings block and the rounds of both players, played by a cheap greedy
+// policy with the rules of tools/engine.h: the fields evolve, rows are
+// cleared, garbage and solid rows are added and a game ends when a player
+// loses or after the round limit. The moves of the bot that reads the stream
+// are ignored; the stream does not depend on them. The output depends only
+// on the options, so a seed always gives the same stream.
+
+#include "engine.h"
+#include "../game.h"
+#include "../pieces.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct StreamConfig
+{
+   uint64_t seed = 1;
+   int64_t rounds = 1000;   // in all the games
+   int64_t megabytes = 0;   // stop after the size instead, if not 0
+   int32_t minWidth = 10;
+   int32_t maxWidth = 10;
+   int32_t minHeight = 20;
+   int32_t maxHeight = 20;
+   int32_t timeBank = 10000;
+   int32_t timePerMove = 500;
+   int32_t maxRounds = 1000; // of a game
+   int32_t actionEvery = 1;  // rounds between the action requests, 0 for none
+   int32_t randomMoves = 8;  // percent of the moves that ignore the policy
+   bool noise = false;       // Round and Output lines of the engine logs
+};
+
+struct Move
+{
+   int32_t rotation = 0;
+   int32_t x = 0;
+   int32_t y = 0;
+};
+
+class StreamGenerator
+{
+   const StreamConfig& mConfig;
+   const Settings& mPieces;
+   std::vector<char> mPieceIds;
+   std::mt19937_64 mRand;
+   std::vector<Move> mMoves;
+   std::string mBuffer;
+   int64_t mWritten = 0;
+   int64_t mRounds = 0;
+
+   struct Player
+   {
+      std::string name;
+      EngineField field;
+      int32_t rowPoints = 0;
+      int32_t combo = 0;
+      int32_t timeBank = 0;
+      int32_t garbageOut = 0;
+      bool lost = false;
+      Player( std::string name_, int32_t width, int32_t height, int32_t timeBank_ )
+         : name( name_ ), field( width, height ), timeBank( timeBank_ )
+      { }
+   };
+
+public:
+   StreamGenerator( const StreamConfig& config, const Settings& pieces )
+      : mConfig( config ), mPieces( pieces ), mRand( config.seed )
+   {
+      for ( const auto& p : pieces.pieces )
+         mPieceIds.push_back( p.first );
+      std::sort( ITALL( mPieceIds ));
+   }
+
+   // Write games until the requested number of rounds or bytes is reached.
+   void run( std::ostream& out )
+   {
+      for ( int32_t game = 0; !done(); ++game )
+         play( out, game );
+      flush( out );
+   }
+
+private:
+   bool done() const
+   {
+      if ( mConfig.megabytes > 0 )
+         return mWritten + int64_t( mBuffer.size() ) >= mConfig.megabytes << 20;
+      return mRounds >= mConfig.rounds;
+   }
+
+   int32_t uniform( int32_t lo, int32_t hi )
+   {
+      return lo + int32_t( mRand() % uint64_t( hi - lo + 1 ));
+   }
+
+   void flush( std::ostream& out )
+   {
+      out.write( mBuffer.data(), mBuffer.size() );
+      mWritten += mBuffer.size();
+      mBuffer.clear();
+   }
+
+   void line( const std::string& text )
+   {
+      mBuffer += text;
+      mBuffer += '\n';
+   }
+
+   void play( std::ostream& out, int32_t game )
+   {
+      int32_t width = uniform( mConfig.minWidth, mConfig.maxWidth );
+      int32_t height = uniform( mConfig.minHeight, mConfig.maxHeight );
+      std::vector<Player> players;
+      for ( int i = 0; i < 2; ++i )
+         players.emplace_back( "player" + std::to_string( i + 1 ), width, height, mConfig.timeBank );
+      auto mine = game % 2;
+      auto& me = players[mine];
+
+      line( "settings timebank " + std::to_string( mConfig.timeBank ));
+      line( "settings time_per_move " + std::to_string( mConfig.timePerMove ));
+      line( "settings player_names player1,player2" );
+      line( "settings your_bot " + me.name );
+      line( "settings field_height " + std::to_string( height ));
+      line( "settings field_width " + std::to_string( width ));
+
+      auto randomPiece = [&]() { return mPieceIds[mRand() % mPieceIds.size()]; };
+      char nextId = randomPiece();
+      for ( int32_t round = 1; round <= mConfig.maxRounds && !done(); ++round ) {
+         char thisId = nextId;
+         nextId = randomPiece();
+         const Piece& piece = *mPieces.pieces.at( thisId );
+         int32_t spawnX = ( width - piece.size ) / 2;
+         int32_t spawnY = -1;
+
+         for ( auto& p : players )
+            if ( !p.field.fits( piece.shapes[0], spawnX, spawnY ))
+               p.lost = true;
+         if ( players[0].lost || players[1].lost )
+            break;
+
+         if ( mConfig.noise )
+            line( "Round " + std::to_string( round ));
+         line( "update game round " + std::to_string( round ));
+         line( std::string( "update game this_piece_type " ) + thisId );
+         line( std::string( "update game next_piece_type " ) + nextId );
+         line( "update game this_piece_position " + std::to_string( spawnX ) + ","
+               + std::to_string( spawnY ));
+         for ( auto& p : players ) {
+            line( "update " + p.name + " row_points " + std::to_string( p.rowPoints ));
+            line( "update " + p.name + " combo " + std::to_string( p.combo ));
+            mBuffer += "update " + p.name + " field ";
+            p.field.write( mBuffer, &piece.shapes[0], spawnX, spawnY );
+            mBuffer += '\n';
+         }
+
+         Move moves[2];
+         for ( int i = 0; i < 2; ++i )
+            moves[i] = chooseMove( players[i].field, piece, spawnX, spawnY );
+
+         if ( mConfig.actionEvery > 0 && round % mConfig.actionEvery == 0 ) {
+            line( "action moves " + std::to_string( me.timeBank ));
+            if ( mConfig.noise )
+               line( "Output from your bot: \"" + moveCommands( moves[mine], spawnX ) + "\"" );
+            // The bot would use some of the time.
+            int32_t used = uniform( 0, mConfig.timePerMove * 3 / 2 );
+            me.timeBank = std::max( mConfig.timePerMove,
+                  std::min( mConfig.timeBank, me.timeBank - used + mConfig.timePerMove ));
+         }
+         mBuffer += '\n';
+         ++mRounds;
+
+         for ( int i = 0; i < 2; ++i ) {
+            auto& p = players[i];
+            const auto& mv = moves[i];
+            if ( !p.field.lock( piece.shapes[mv.rotation], mv.x, mv.y )) {
+               p.lost = true;
+               continue;
+            }
+            auto cleared = p.field.clearRows();
+            p.rowPoints += clearPoints( cleared, p.combo, !p.field.hasBlocks() );
+            p.combo = cleared > 0 ? p.combo + 1 : 0;
+         }
+         for ( int i = 0; i < 2; ++i ) {
+            auto& p = players[i];
+            auto& other = players[1 - i];
+            auto garbage = p.rowPoints / GARBAGE_POINTS - p.garbageOut;
+            p.garbageOut += garbage;
+            while ( garbage-- > 0 )
+               if ( !other.field.insertRow( CELL_BLOCK, uniform( 0, width - 1 )))
+                  other.lost = true;
+         }
+         if ( round % SOLID_ROW_ROUNDS == 0 ) {
+            for ( auto& p : players )
+               if ( !p.field.insertRow( CELL_SOLID, -1 ))
+                  p.lost = true;
+         }
+         if ( players[0].lost || players[1].lost )
+            break;
+
+         if ( mBuffer.size() >= 1 << 20 )
+            flush( out );
+      }
+   }
+
+   // The placements reachable by turning and moving at the spawn row and
+   // dropping, without the slides under overhangs.
+   void listMoves( const EngineField& field, const Piece& piece, int32_t spawnY )
+   {
+      mMoves.clear();
+      for ( int32_t rot = 0; rot < int32_t( piece.shapes.size() ); ++rot ) {
+         const auto& shape = piece.shapes[rot];
+         for ( int32_t x = -piece.size; x < field.width(); ++x ) {
+            if ( !field.fits( shape, x, spawnY ))
+               continue;
+            int32_t y = spawnY;
+            while ( field.fits( shape, x, y + 1 ))
+               ++y;
+            mMoves.push_back( Move{ rot, x, y } );
+         }
+      }
+   }
+
+   // Prefer the placements that clear rows, cover few empty cells and land
+   // low. Some moves are random so that the fields get holes and the players
+   // top out now and then.
+   Move chooseMove( const EngineField& field, const Piece& piece, int32_t spawnX, int32_t spawnY )
+   {
+      listMoves( field, piece, spawnY );
+      if ( mMoves.empty() )
+         return Move{ 0, spawnX, spawnY };
+      if ( int32_t( mRand() % 100 ) < mConfig.randomMoves )
+         return mMoves[mRand() % mMoves.size()];
+
+      Move best = mMoves[0];
+      int32_t bestScore = 0;
+      for ( size_t i = 0; i < mMoves.size(); ++i ) {
+         auto score = scoreMove( field, piece.shapes[mMoves[i].rotation], mMoves[i] );
+         if ( i == 0 || score > bestScore ) {
+            best = mMoves[i];
+            bestScore = score;
+         }
+      }
+      return best;
+   }
+
+   static int32_t scoreMove( const EngineField& field, const Shape& shape, const Move& mv )
+   {
+      auto inShape = [&]( int32_t r, int32_t c ) {
+         for ( const auto& pt : shape.coords )
+            if ( mv.y + pt.r == r && mv.x + pt.c == c )
+               return true;
+         return false;
+      };
+
+      int32_t top = field.height();
+      int32_t bottom = 0;
+      int32_t covered = 0;
+      for ( const auto& pt : shape.coords ) {
+         auto r = mv.y + pt.r;
+         auto c = mv.x + pt.c;
+         top = std::min( top, r );
+         bottom = std::max( bottom, r );
+         if ( r + 1 < field.height() && field.at( r + 1, c ) == CELL_EMPTY && !inShape( r + 1, c ))
+            ++covered;
+      }
+      int32_t cleared = 0;
+      for ( int32_t r = std::max( 0, top ); r <= bottom; ++r ) {
+         bool full = true;
+         for ( int32_t c = 0; c < field.width() && full; ++c )
+            full = field.at( r, c ) == CELL_BLOCK || inShape( r, c );
+         if ( full )
+            ++cleared;
+      }
+      return 8 * cleared - 6 * covered + top;
+   }
+
+   // The commands of the move as the bot would send them.
+   static std::string moveCommands( const Move& mv, int32_t spawnX )
+   {
+      std::string res;
+      for ( int32_t i = 0; i < mv.rotation; ++i )
+         res += "turnright,";
+      for ( int32_t x = spawnX; x > mv.x; --x )
+         res += "left,";
+      for ( int32_t x = spawnX; x < mv.x; ++x )
+         res += "right,";
+      return res + "drop";
+   }
+};
+
+void usage()
+{
+   std::cerr <<
+      "Usage: streamgen [options] [output-file]\n"
+      "Writes a stream of games in the text protocol to the file or to stdout.\n"
+      "  -s N      random seed (default 1)\n"
+      "  -n N      number of rounds in all the games (default 1000)\n"
+      "  -M N      stop after N megabytes instead of a number of rounds\n"
+      "  -r N      maximum number of rounds of a game (default 1000)\n"
+      "  -w N      field width (default 10)\n"
+      "  -h N      field height (default 20)\n"
+      "  -W N      vary the width of the games from -w to N\n"
+      "  -H N      vary the height of the games from -h to N\n"
+      "  -b MS     time bank (default 10000)\n"
+      "  -t MS     time per move (default 500)\n"
+      "  -a N      request the moves every N rounds, 0 for never (default 1)\n"
+      "  -x N      percent of random moves (default 8)\n"
+      "  -d        add the Round and Output lines of the engine logs; only a bot\n"
+      "            built with DEBUG_INTRFC skips them\n";
+}
+
+} // namespace
+
+int main( int argc, char* argv[] )
+{
+   StreamConfig config;
+   std::string output;
+   int32_t maxWidth = 0;
+   int32_t maxHeight = 0;
+
+   for ( int i = 1; i < argc; ++i ) {
+      std::string arg = argv[i];
+      auto value = [&]() { return i + 1 < argc ? atoll( argv[++i] ) : 0; };
+      if ( arg == "-s" ) config.seed = value();
+      else if ( arg == "-n" ) config.rounds = value();
+      else if ( arg == "-M" ) config.megabytes = value();
+      else if ( arg == "-r" ) config.maxRounds = value();
+      else if ( arg == "-w" ) config.minWidth = value();
+      else if ( arg == "-h" ) config.minHeight = value();
+      else if ( arg == "-W" ) maxWidth = value();
+      else if ( arg == "-H" ) maxHeight = value();
+      else if ( arg == "-b" ) config.timeBank = value();
+      else if ( arg == "-t" ) config.timePerMove = value();
+      else if ( arg == "-a" ) config.actionEvery = value();
+      else if ( arg == "-x" ) config.randomMoves = value();
+      else if ( arg == "-d" ) config.noise = true;
+      else if ( arg.size() > 1 && arg[0] == '-' ) {
+         usage();
+         return 1;
+      }
+      else
+         output = arg;
+   }
+   config.maxWidth = std::max( config.minWidth, maxWidth );
+   config.maxHeight = std::max( config.minHeight, maxHeight );
+   if ( config.minWidth < 4 || config.minHeight < 4 || config.maxRounds < 1
+         || config.actionEvery < 0 || config.timePerMove < 0 ) {
+      usage();
+      return 1;
+   }
+
+   auto psettings = std::make_shared<Settings>();
+   loadStandardPieces( psettings );
+   StreamGenerator generator( config, *psettings );
+
+   std::ios::sync_with_stdio( false );
+   if ( output.empty() ) {
+      generator.run( std::cout );
+      return std::cout.good() ? 0 : 1;
+   }
+   std::ofstream out( output, std::ios::binary );
+   if ( !out ) {
+      std::cerr << "Can not write " << output << "\n";
+      return 1;
+   }
+   generator.run( out );
+   return out.good() ? 0 : 1;
+}
@@ -0,0 +1,737 @@
+/**
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+// A local tournament runner. It plays the role of the game engine: it starts
+// the bots as child processes, talks to them through pipes with the text
+// protocol, enforces the time banks and reports Elo and latency statistics.
+// With -B it asks the bots for the binary protocol (binproto.h) and falls back
+// to text for the bots that do not accept it.
+//
+// The rules follow the official engine closely enough for A/B testing:
+//  - both players get the same sequence of pieces,
+//  - a cleared row gives 0/3/6/10 points for 1/2/3/4 rows, a combo adds the
+//    number of previous consecutive clears and a perfect clear gives 18,
+//  - every GARBAGE_POINTS row points add a garbage row to the opponent,
+//  - every SOLID_ROW_ROUNDS rounds a solid row is added to both fields,
+//  - a piece that is not dropped explicitly is dropped after the last move,
+//  - a player loses when the new piece does not fit, a piece is locked
+//    above the field, a row is pushed out of the field or the time bank is
+//    exhausted.
+
+#include "engine.h"
+#include "../game.h"
+#include "../binproto.h"
+#include "../parsers.h"
+#include "../pieces.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+struct EngineConfig
+{
+   int32_t fieldWidth = 10;
+   int32_t fieldHeight = 20;
+   int32_t timeBank = 10000;
+   int32_t timePerMove = 500;
+   int32_t maxRounds = 1000;
+   bool showStderr = false;
+   bool binary = false;
+};
+
+class BotProcess
+{
+   pid_t mPid = -1;
+   int mToBot = -1;
+   int mFromBot = -1;
+   std::string mBuffer;
+
+public:
+   ~BotProcess()
+   {
+      stop();
+   }
+
+   bool start( const std::string& command, bool showStderr )
+   {
+      int toBot[2], fromBot[2];
+      if ( pipe2( toBot, O_CLOEXEC ) != 0 )
+         return false;
+      if ( pipe2( fromBot, O_CLOEXEC ) != 0 ) {
+         close( toBot[0] );
+         close( toBot[1] );
+         return false;
+      }
+
+      mPid = fork();
+      if ( mPid == 0 ) {
+         dup2( toBot[0], 0 );
+         dup2( fromBot[1], 1 );
+         if ( !showStderr ) {
+            int devnull = open( "/dev/null", O_WRONLY );
+            if ( devnull >= 0 )
+               dup2( devnull, 2 );
+         }
+         execl( "/bin/sh", "sh", "-c", command.c_str(), (char*) nullptr );
+         _exit( 127 );
+      }
+
+      close( toBot[0] );
+      close( fromBot[1] );
+      mToBot = toBot[1];
+      mFromBot = fromBot[0];
+      if ( mPid < 0 ) {
+         stop();
+         return false;
+      }
+      return true;
+   }
+
+   bool send( const std::string& text )
+   {
+      const char* p = text.data();
+      size_t left = text.size();
+      while ( left > 0 ) {
+         auto n = write( mToBot, p, left );
+         if ( n < 0 && errno == EINTR )
+            continue;
+         if ( n <= 0 )
+            return false;
+         p += n;
+         left -= n;
+      }
+      return true;
+   }
+
+   enum ReadStatus { READ_OK, READ_TIMEOUT, READ_CLOSED };
+
+   ReadStatus readLine( std::string& line, int32_t timeoutMs )
+   {
+      auto deadline = clock::now() + std::chrono::milliseconds( timeoutMs );
+      while ( true ) {
+         auto eol = mBuffer.find( '\n' );
+         if ( eol != std::string::npos ) {
+            line = mBuffer.substr( 0, eol );
+            mBuffer.erase( 0, eol + 1 );
+            return READ_OK;
+         }
+         auto status = fill( deadline );
+         if ( status != READ_OK )
+            return status;
+      }
+   }
+
+   // Read the payload of a binary frame.
+   ReadStatus readFrame( std::string& payload, int32_t timeoutMs )
+   {
+      auto deadline = clock::now() + std::chrono::milliseconds( timeoutMs );
+      while ( true ) {
+         if ( mBuffer.size() >= 4 ) {
+            auto size = binaryFrameSize( (const unsigned char*) mBuffer.data() );
+            if ( size > BIN_MAX_FRAME )
+               return READ_CLOSED;
+            if ( mBuffer.size() >= 4 + size ) {
+               payload = mBuffer.substr( 4, size );
+               mBuffer.erase( 0, 4 + size );
+               return READ_OK;
+            }
+         }
+         auto status = fill( deadline );
+         if ( status != READ_OK )
+            return status;
+      }
+   }
+
+private:
+   using clock = std::chrono::steady_clock;
+
+   // Wait for more output of the bot and append it to the buffer.
+   ReadStatus fill( clock::time_point deadline )
+   {
+      while ( true ) {
+         auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+               deadline - clock::now() ).count();
+         if ( left < 0 )
+            return READ_TIMEOUT;
+
+         pollfd pfd = { mFromBot, POLLIN, 0 };
+         auto rv = poll( &pfd, 1, int( left ) + 1 );
+         if ( rv < 0 && errno == EINTR )
+            continue;
+         if ( rv == 0 )
+            return READ_TIMEOUT;
+         if ( rv < 0 )
+            return READ_CLOSED;
+
+         char buf[4096];
+         auto n = read( mFromBot, buf, sizeof( buf ));
+         if ( n <= 0 )
+            return READ_CLOSED;
+         mBuffer.append( buf, n );
+         return READ_OK;
+      }
+   }
+
+public:
+   void stop()
+   {
+      if ( mToBot >= 0 )
+         close( mToBot );
+      if ( mFromBot >= 0 )
+         close( mFromBot );
+      mToBot = mFromBot = -1;
+      if ( mPid > 0 ) {
+         // Give the bot a moment to exit after the end of input.
+         int status;
+         for ( int i = 0; i < 50; ++i ) {
+            if ( waitpid( mPid, &status, WNOHANG ) == mPid ) {
+               mPid = -1;
+               return;
+            }
+            std::this_thread::sleep_for( std::chrono::milliseconds( 10 ));
+         }
+         kill( mPid, SIGKILL );
+         waitpid( mPid, &status, 0 );
+      }
+      mPid = -1;
+   }
+};
+
+struct PlayerResult
+{
+   std::vector<double> latencies; // ms
+   int32_t timeouts = 0;
+   int32_t crashes = 0;
+};
+
+struct MatchResult
+{
+   int32_t winner = -1; // -1 for a draw
+   int32_t rounds = 0;
+   PlayerResult players[2];
+};
+
+class Match
+{
+   const EngineConfig& mConfig;
+   const Settings& mPieces;
+   std::vector<char> mPieceIds;
+
+   struct Player
+   {
+      std::string name;
+      BotProcess bot;
+      EngineField field;
+      int32_t rowPoints = 0;
+      int32_t combo = 0;
+      int32_t timeBank = 0;
+      int32_t garbageOut = 0;
+      bool lost = false;
+      bool binary = false;
+      Player( std::string name_, const EngineConfig& config )
+         : name( name_ ), field( config.fieldWidth, config.fieldHeight ), timeBank( config.timeBank )
+      { }
+   };
+
+public:
+   Match( const EngineConfig& config, const Settings& pieces )
+      : mConfig( config ), mPieces( pieces )
+   {
+      for ( const auto& p : pieces.pieces )
+         mPieceIds.push_back( p.first );
+      std::sort( ITALL( mPieceIds ));
+   }
+
+   MatchResult play( const std::string commands[2], uint32_t seed )
+   {
+      MatchResult result;
+      std::mt19937 rand( seed );
+      std::vector<std::unique_ptr<Player>> players;
+      for ( int i = 0; i < 2; ++i ) {
+         players.emplace_back( new Player( "player" + std::to_string( i + 1 ), mConfig ));
+         if ( !players[i]->bot.start( commands[i], mConfig.showStderr )) {
+            players[i]->lost = true;
+            ++result.players[i].crashes;
+         }
+      }
+
+      if ( mConfig.binary ) {
+         for ( auto& pp : players )
+            if ( !pp->lost )
+               negotiateBinary( *pp );
+      }
+
+      for ( int i = 0; i < 2; ++i ) {
+         if ( players[i]->binary ) {
+            std::string frame;
+            BinaryEncoder out( frame );
+            out.begin( BIN_SETTINGS );
+            out.put32( mConfig.timeBank );
+            out.put32( mConfig.timePerMove );
+            out.put8( mConfig.fieldWidth );
+            out.put8( mConfig.fieldHeight );
+            out.put8( i );
+            out.put8( players.size() );
+            for ( auto& pp : players )
+               out.putString( pp->name );
+            out.end();
+            if ( !players[i]->bot.send( frame )) {
+               players[i]->lost = true;
+               ++result.players[i].crashes;
+            }
+            continue;
+         }
+         std::stringstream ss;
+         ss << "settings timebank " << mConfig.timeBank << "\n"
+            << "settings time_per_move " << mConfig.timePerMove << "\n"
+            << "settings player_names player1,player2\n"
+            << "settings your_bot " << players[i]->name << "\n"
+            << "settings field_height " << mConfig.fieldHeight << "\n"
+            << "settings field_width " << mConfig.fieldWidth << "\n";
+         if ( !players[i]->lost && !players[i]->bot.send( ss.str() )) {
+            players[i]->lost = true;
+            ++result.players[i].crashes;
+         }
+      }
+
+      auto randomPiece = [&]() { return mPieceIds[rand() % mPieceIds.size()]; };
+      char nextId = randomPiece();
+      int32_t round = 0;
+      while ( !players[0]->lost && !players[1]->lost && round < mConfig.maxRounds ) {
+         ++round;
+         char thisId = nextId;
+         nextId = randomPiece();
+         const Piece& piece = *mPieces.pieces.at( thisId );
+         int32_t spawnX = ( mConfig.fieldWidth - piece.size ) / 2;
+         int32_t spawnY = -1;
+
+         for ( auto& pp : players )
+            if ( !pp->field.fits( piece.shapes[0], spawnX, spawnY ))
+               pp->lost = true;
+         if ( players[0]->lost || players[1]->lost )
+            break;
+
+         std::stringstream ss;
+         ss << "update game round " << round << "\n"
+            << "update game this_piece_type " << thisId << "\n"
+            << "update game next_piece_type " << nextId << "\n"
+            << "update game this_piece_position " << spawnX << "," << spawnY << "\n";
+         for ( auto& pp : players ) {
+            ss << "update " << pp->name << " row_points " << pp->rowPoints << "\n"
+               << "update " << pp->name << " combo " << pp->combo << "\n"
+               << "update " << pp->name << " field ";
+            pp->field.write( ss, &piece.shapes[0], spawnX, spawnY );
+            ss << "\n";
+         }
+         auto updates = ss.str();
+
+         std::string binUpdates;
+         if ( mConfig.binary ) {
+            BinaryEncoder out( binUpdates );
+            out.begin( BIN_ROUND );
+            out.put32( round );
+            out.put8( thisId );
+            out.put8( nextId );
+            out.put8( spawnX );
+            out.put8( spawnY );
+            out.end();
+            for ( size_t i = 0; i < players.size(); ++i ) {
+               out.begin( BIN_PLAYER );
+               out.put8( i );
+               out.put32( players[i]->rowPoints );
+               out.put32( players[i]->combo );
+               players[i]->field.encode( out );
+               out.end();
+            }
+         }
+
+         for ( int i = 0; i < 2; ++i )
+            playTurn( *players[i], result.players[i], players[i]->binary ? binUpdates : updates,
+                  piece, spawnX, spawnY );
+
+         for ( int i = 0; i < 2; ++i ) {
+            auto& me = *players[i];
+            auto& other = *players[1 - i];
+            auto garbage = me.rowPoints / GARBAGE_POINTS - me.garbageOut;
+            me.garbageOut += garbage;
+            while ( garbage-- > 0 )
+               if ( !other.field.insertRow( CELL_BLOCK, rand() % mConfig.fieldWidth ))
+                  other.lost = true;
+         }
+         if ( round % SOLID_ROW_ROUNDS == 0 ) {
+            for ( auto& pp : players )
+               if ( !pp->field.insertRow( CELL_SOLID, -1 ))
+                  pp->lost = true;
+         }
+      }
+
+      result.rounds = round;
+      if ( players[0]->lost != players[1]->lost )
+         result.winner = players[0]->lost ? 1 : 0;
+      return result;
+   }
+
+private:
+   // A bot that does not answer the request in time gets the text protocol.
+   void negotiateBinary( Player& me )
+   {
+      std::string line;
+      if ( !me.bot.send( "protocol binary\n" ))
+         return;
+      me.binary = me.bot.readLine( line, 1000 ) == BotProcess::READ_OK && line == "protocol binary";
+   }
+
+   void playTurn( Player& me, PlayerResult& stats, const std::string& updates,
+         const Piece& piece, int32_t x, int32_t y )
+   {
+      if ( me.lost )
+         return;
+
+      using clock = std::chrono::steady_clock;
+      std::string request = updates;
+      if ( me.binary ) {
+         BinaryEncoder out( request );
+         out.begin( BIN_ACTION );
+         out.put32( me.timeBank );
+         out.end();
+      }
+      else
+         request += "action moves " + std::to_string( me.timeBank ) + "\n";
+
+      std::string line;
+      auto start = clock::now();
+      if ( !me.bot.send( request )) {
+         ++stats.crashes;
+         me.lost = true;
+         return;
+      }
+      auto status = me.binary ? me.bot.readFrame( line, me.timeBank ) : me.bot.readLine( line, me.timeBank );
+      auto elapsed = std::chrono::duration<double, std::milli>( clock::now() - start ).count();
+      if ( status == BotProcess::READ_CLOSED ) {
+         ++stats.crashes;
+         me.lost = true;
+         return;
+      }
+      if ( status == BotProcess::READ_TIMEOUT ) {
+         ++stats.timeouts;
+         me.lost = true;
+         return;
+      }
+      stats.latencies.push_back( elapsed );
+      me.timeBank = std::min( mConfig.timeBank, me.timeBank - int32_t( elapsed ) + mConfig.timePerMove );
+
+      std::vector<BinaryMove> moves;
+      if ( me.binary ) {
+         if ( line.empty() || line[0] != BIN_MOVES ) {
+            ++stats.crashes;
+            me.lost = true;
+            return;
+         }
+         for ( size_t i = 1; i < line.size(); ++i )
+            moves.push_back( BinaryMove( line[i] ));
+      }
+      else
+         parseMoves( line, moves );
+
+      int32_t rot = 0;
+      auto nshapes = int32_t( piece.shapes.size() );
+      for ( auto move : moves ) {
+         if ( move == BIN_LEFT && me.field.fits( piece.shapes[rot], x - 1, y ))
+            --x;
+         else if ( move == BIN_RIGHT && me.field.fits( piece.shapes[rot], x + 1, y ))
+            ++x;
+         else if ( move == BIN_DOWN && me.field.fits( piece.shapes[rot], x, y + 1 ))
+            ++y;
+         else if ( move == BIN_TURNRIGHT && me.field.fits( piece.shapes[( rot + 1 ) % nshapes], x, y ))
+            rot = ( rot + 1 ) % nshapes;
+         else if ( move == BIN_TURNLEFT && me.field.fits( piece.shapes[( rot + nshapes - 1 ) % nshapes], x, y ))
+            rot = ( rot + nshapes - 1 ) % nshapes;
+         else if ( move == BIN_DROP )
+            break;
+      }
+      while ( me.field.fits( piece.shapes[rot], x, y + 1 ))
+         ++y;
+
+      if ( !me.field.lock( piece.shapes[rot], x, y )) {
+         me.lost = true;
+         return;
+      }
+
+      auto cleared = me.field.clearRows();
+      me.rowPoints += clearPoints( cleared, me.combo, !me.field.hasBlocks() );
+      me.combo = cleared > 0 ? me.combo + 1 : 0;
+   }
+
+   static void parseMoves( const std::string& line, std::vector<BinaryMove>& moves )
+   {
+      std::stringstream ss( line );
+      std::string move;
+      while ( std::getline( ss, move, ',' )) {
+         if ( move == "left" ) moves.push_back( BIN_LEFT );
+         else if ( move == "right" ) moves.push_back( BIN_RIGHT );
+         else if ( move == "down" ) moves.push_back( BIN_DOWN );
+         else if ( move == "turnright" ) moves.push_back( BIN_TURNRIGHT );
+         else if ( move == "turnleft" ) moves.push_back( BIN_TURNLEFT );
+         else if ( move == "drop" ) moves.push_back( BIN_DROP );
+      }
+   }
+};
+
+struct BotStats
+{
+   std::string command;
+   int32_t wins = 0;
+   int32_t draws = 0;
+   int32_t losses = 0;
+   int32_t timeouts = 0;
+   int32_t crashes = 0;
+   std::vector<double> latencies;
+
+   int32_t games() const
+   {
+      return wins + draws + losses;
+   }
+};
+
+struct Pairing
+{
+   int32_t bots[2];
+   uint32_t seed;
+};
+
+double eloFromScore( double score )
+{
+   return -400.0 * std::log10( 1.0 / score - 1.0 );
+}
+
+double percentile( const std::vector<double>& sorted, double p )
+{
+   if ( sorted.empty() )
+      return 0;
+   auto i = size_t( p * ( sorted.size() - 1 ) + 0.5 );
+   return sorted[std::min( i, sorted.size() - 1 )];
+}
+
+void report( std::vector<BotStats>& stats, const std::vector<std::vector<double>>& pairScore,
+      const std::vector<std::vector<int32_t>>& pairGames )
+{
+   std::cout << "\n"
+      << std::setw( 4 ) << "bot" << std::setw( 7 ) << "games" << std::setw( 6 ) << "win"
+      << std::setw( 6 ) << "draw" << std::setw( 6 ) << "loss" << std::setw( 8 ) << "score"
+      << std::setw( 9 ) << "elo" << std::setw( 17 ) << "95% ci"
+      << std::setw( 9 ) << "mean ms" << std::setw( 8 ) << "p50" << std::setw( 8 ) << "p95"
+      << std::setw( 8 ) << "p99" << std::setw( 8 ) << "max"
+      << std::setw( 6 ) << "tout" << std::setw( 6 ) << "crash" << "\n";
+
+   std::cout << std::fixed;
+   for ( size_t b = 0; b < stats.size(); ++b ) {
+      auto& s = stats[b];
+      double n = std::max( 1, s.games() );
+      double score = ( s.wins + 0.5 * s.draws ) / n;
+      double var = ( s.wins * std::pow( 1.0 - score, 2 ) + s.draws * std::pow( 0.5 - score, 2 )
+            + s.losses * std::pow( score, 2 )) / n;
+      double margin = 1.96 * std::sqrt( var / n );
+      auto clip = [n]( double v ) { return std::min( 1.0 - 0.5 / n, std::max( 0.5 / n, v )); };
+
+      std::sort( ITALL( s.latencies ));
+      double mean = 0;
+      for ( auto l : s.latencies )
+         mean += l;
+      if ( !s.latencies.empty() )
+         mean /= s.latencies.size();
+
+      std::cout << std::setw( 4 ) << b << std::setw( 7 ) << s.games() << std::setw( 6 ) << s.wins
+         << std::setw( 6 ) << s.draws << std::setw( 6 ) << s.losses
+         << std::setprecision( 3 ) << std::setw( 8 ) << score
+         << std::setprecision( 1 ) << std::setw( 9 ) << eloFromScore( clip( score ))
+         << std::setw( 8 ) << eloFromScore( clip( score - margin )) << " .."
+         << std::setw( 6 ) << eloFromScore( clip( score + margin ))
+         << std::setprecision( 2 ) << std::setw( 9 ) << mean
+         << std::setw( 8 ) << percentile( s.latencies, 0.50 )
+         << std::setw( 8 ) << percentile( s.latencies, 0.95 )
+         << std::setw( 8 ) << percentile( s.latencies, 0.99 )
+         << std::setw( 8 ) << ( s.latencies.empty() ? 0 : s.latencies.back() )
+         << std::setw( 6 ) << s.timeouts << std::setw( 6 ) << s.crashes << "\n";
+   }
+
+   std::cout << "\nElo is relative to the opponents of the bot.\n";
+   if ( stats.size() > 2 ) {
+      std::cout << "\nPairwise Elo (row against column):\n";
+      for ( size_t a = 0; a < stats.size(); ++a ) {
+         std::cout << std::setw( 4 ) << a;
+         for ( size_t b = 0; b < stats.size(); ++b ) {
+            if ( a == b || pairGames[a][b] == 0 )
+               std::cout << std::setw( 9 ) << "-";
+            else {
+               double n = pairGames[a][b];
+               double score = std::min( 1.0 - 0.5 / n, std::max( 0.5 / n, pairScore[a][b] / n ));
+               std::cout << std::setprecision( 1 ) << std::setw( 9 ) << eloFromScore( score );
+            }
+         }
+         std::cout << "\n";
+      }
+   }
+
+   std::cout << "\n";
+   for ( size_t b = 0; b < stats.size(); ++b )
+      std::cout << std::setw( 4 ) << b << ": " << stats[b].command << "\n";
+}
+
+void usage()
+{
+   std::cerr <<
+      "Usage: tournament [options] bot-command bot-command [bot-command...]\n"
+      "Every pair of bots plays the same sequences of pieces from both seats.\n"
+      "  -g N      games per pair (default 100)\n"
+      "  -j N      matches to run in parallel (default: number of cores)\n"
+      "  -s N      random seed (default 1)\n"
+      "  -b MS     time bank (default 10000)\n"
+      "  -t MS     time per move (default 500)\n"
+      "  -r N      maximum number of rounds, then it is a draw (default 1000)\n"
+      "  -w N      field width (default 10)\n"
+      "  -h N      field height (default 20)\n"
+      "  -e        show stderr of the bots\n"
+      "  -B        use the binary protocol with the bots that accept it\n";
+}
+
+} // namespace
+
+int main( int argc, char* argv[] )
+{
+   EngineConfig config;
+   int32_t gamesPerPair = 100;
+   int32_t jobs = std::max( 1u, std::thread::hardware_concurrency() );
+   uint32_t seed = 1;
+   std::vector<std::string> commands;
+
+   for ( int i = 1; i < argc; ++i ) {
+      std::string arg = argv[i];
+      auto value = [&]() { return i + 1 < argc ? atoi( argv[++i] ) : 0; };
+      if ( arg == "-g" ) gamesPerPair = value();
+      else if ( arg == "-j" ) jobs = value();
+      else if ( arg == "-s" ) seed = value();
+      else if ( arg == "-b" ) config.timeBank = value();
+      else if ( arg == "-t" ) config.timePerMove = value();
+      else if ( arg == "-r" ) config.maxRounds = value();
+      else if ( arg == "-w" ) config.fieldWidth = value();
+      else if ( arg == "-h" ) config.fieldHeight = value();
+      else if ( arg == "-e" ) config.showStderr = true;
+      else if ( arg == "-B" ) config.binary = true;
+      else if ( arg.size() > 1 && arg[0] == '-' ) {
+         usage();
+         return 1;
+      }
+      else
+         commands.push_back( arg );
+   }
+   if ( commands.size() < 2 || gamesPerPair < 1 || jobs < 1 || ( config.binary && config.fieldWidth > 255 )) {
+      usage();
+      return 1;
+   }
+
+   signal( SIGPIPE, SIG_IGN );
+
+   auto ppieces = std::make_shared<Settings>();
+   loadStandardPieces( ppieces );
+   const Settings& pieces = *ppieces;
+
+   std::vector<Pairing> pairings;
+   for ( int32_t a = 0; a < int32_t( commands.size() ); ++a ) {
+      for ( int32_t b = a + 1; b < int32_t( commands.size() ); ++b ) {
+         for ( int32_t g = 0; g < gamesPerPair; ++g ) {
+            Pairing p;
+            p.bots[0] = g % 2 == 0 ? a : b;
+            p.bots[1] = g % 2 == 0 ? b : a;
+            p.seed = seed + g / 2;
+            pairings.push_back( p );
+         }
+      }
+   }
+
+   std::vector<BotStats> stats( commands.size() );
+   for ( size_t b = 0; b < commands.size(); ++b )
+      stats[b].command = commands[b];
+   std::vector<std::vector<double>> pairScore( commands.size(), std::vector<double>( commands.size() ));
+   std::vector<std::vector<int32_t>> pairGames( commands.size(), std::vector<int32_t>( commands.size() ));
+
+   std::mutex mutex;
+   std::atomic<size_t> nextMatch( 0 );
+   size_t finished = 0;
+   auto worker = [&]() {
+      Match match( config, pieces );
+      while ( true ) {
+         auto i = nextMatch++;
+         if ( i >= pairings.size() )
+            break;
+         const auto& p = pairings[i];
+         std::string cmds[2] = { commands[p.bots[0]], commands[p.bots[1]] };
+         auto result = match.play( cmds, p.seed );
+
+         std::lock_guard<std::mutex> lock( mutex );
+         for ( int s = 0; s < 2; ++s ) {
+            auto me = p.bots[s];
+            auto other = p.bots[1 - s];
+            auto& st = stats[me];
+            if ( result.winner < 0 ) {
+               ++st.draws;
+               pairScore[me][other] += 0.5;
+            }
+            else if ( result.winner == s ) {
+               ++st.wins;
+               pairScore[me][other] += 1;
+            }
+            else
+               ++st.losses;
+            ++pairGames[me][other];
+            st.timeouts += result.players[s].timeouts;
+            st.crashes += result.players[s].crashes;
+            st.latencies.insert( st.latencies.end(), ITALL( result.players[s].latencies ));
+         }
+         ++finished;
+         std::cerr << "\r" << finished << "/" << pairings.size() << " matches" << std::flush;
+      }
+   };
+
+   std::vector<std::thread> threads;
+   for ( int32_t j = 0; j < jobs; ++j )
+      threads.emplace_back( worker );
+   for ( auto& t : threads )
+      t.join();
+   std::cerr << "\n";
+
+   report( stats, pairScore, pairGames );
+   return 0;
+}
@@ -0,0 +1,149 @@
+/**
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#include "trace.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+std::atomic<bool> Tracer::sEnabled( false );
+
+namespace {
+
+struct ThreadBuffer
+{
+   int32_t tid;
+   std::string name;
+   std::vector<TraceEvent> events;
+   std::atomic<uint64_t> count{ 0 };
+};
+
+std::mutex gMutex;
+std::vector<std::unique_ptr<ThreadBuffer>> gBuffers;
+std::string gPath;
+Tracer::clock::time_point gStart;
+bool gFinished = false;
+thread_local ThreadBuffer* tBuffer = nullptr;
+
+ThreadBuffer& threadBuffer()
+{
+   if ( tBuffer == nullptr ) {
+      std::lock_guard<std::mutex> lock( gMutex );
+      gBuffers.emplace_back( new ThreadBuffer );
+      tBuffer = gBuffers.back().get();
+      tBuffer->tid = gBuffers.size();
+      tBuffer->events.resize( Tracer::BUFFER_SIZE );
+   }
+   return *tBuffer;
+}
+
+void writeString( std::ostream& out, const char* s )
+{
+   out << '"';
+   for ( ; *s; ++s ) {
+      if ( *s == '"' || *s == '\\' )
+         out << '\\';
+      if ( (unsigned char) *s >= 0x20 )
+         out << *s;
+   }
+   out << '"';
+}
+
+void finishAtExit()
+{
+   Tracer::finish();
+}
+
+} // namespace
+
+void Tracer::start( const std::string& path )
+{
+   {
+      std::lock_guard<std::mutex> lock( gMutex );
+      gPath = path;
+      gStart = clock::now();
+      gFinished = false;
+   }
+   std::atexit( finishAtExit );
+   sEnabled = true;
+}
+
+void Tracer::finish()
+{
+   if ( !enabled() )
+      return;
+   sEnabled = false;
+
+   std::lock_guard<std::mutex> lock( gMutex );
+   if ( gFinished )
+      return;
+   gFinished = true;
+
+   std::ofstream out( gPath );
+   out << "{\"traceEvents\":[\n";
+   bool first = true;
+   for ( const auto& pbuf : gBuffers ) {
+      if ( !pbuf->name.empty() ) {
+         out << ( first ? "" : ",\n" )
+            << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << pbuf->tid
+            << ",\"args\":{\"name\":";
+         writeString( out, pbuf->name.c_str() );
+         out << "}}";
+         first = false;
+      }
+
+      auto count = pbuf->count.load( std::memory_order_acquire );
+      auto begin = count > BUFFER_SIZE ? count - BUFFER_SIZE : 0;
+      for ( auto i = begin; i < count; ++i ) {
+         const auto& ev = pbuf->events[i % BUFFER_SIZE];
+         out << ( first ? "" : ",\n" ) << "{\"name\":";
+         writeString( out, ev.name );
+         out << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << pbuf->tid
+            << ",\"ts\":" << ev.start << ",\"dur\":" << ev.duration;
+         if ( ev.argName != nullptr ) {
+            out << ",\"args\":{";
+            writeString( out, ev.argName );
+            out << ":" << ev.argValue << "}";
+         }
+         out << "}";
+         first = false;
+      }
+   }
+   out << "\n]}\n";
+}
+
+void Tracer::setThreadName( const char* name )
+{
+   if ( enabled() )
+      threadBuffer().name = name;
+}
+
+uint64_t Tracer::now()
+{
+   return std::chrono::duration_cast<std::chrono::microseconds>( clock::now() - gStart ).count();
+}
+
+void Tracer::record( const TraceEvent& event )
+{
+   auto& buf = threadBuffer();
+   auto i = buf.count.load( std::memory_order_relaxed );
+   buf.events[i % BUFFER_SIZE] = event;
+   buf.count.store( i + 1, std::memory_order_release );
+}
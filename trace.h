@@ -0,0 +1,96 @@
+/**
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#pragma once
+
+// Timeline tracing in the Chrome trace-event format (chrome://tracing,
+// Perfetto). Spans are recorded into a ring buffer of the thread that created
+// them and all buffers are written to a file when the program exits. When
+// tracing is not started a span costs one load of a flag.
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+struct TraceEvent
+{
+   const char* name;    // must outlive the tracer: a literal or a stable key
+   const char* argName; // nullptr when there is no argument
+   int64_t argValue;
+   uint64_t start;      // us since the start of tracing
+   uint64_t duration;   // us
+};
+
+class Tracer
+{
+   static std::atomic<bool> sEnabled;
+
+public:
+   using clock = std::chrono::steady_clock;
+
+   // Number of events kept for each thread; older events are overwritten.
+   static const size_t BUFFER_SIZE = 1 << 16;
+
+   static bool enabled()
+   {
+      return sEnabled.load( std::memory_order_relaxed );
+   }
+
+   // Start recording. The trace is written to path by finish() or at exit.
+   static void start( const std::string& path );
+
+   // Write the trace and stop recording. Only the first call writes.
+   static void finish();
+
+   // Name of the calling thread in the timeline.
+   static void setThreadName( const char* name );
+
+   static uint64_t now();
+   static void record( const TraceEvent& event );
+};
+
+class TraceSpan
+{
+   const char* mName;
+   const char* mArgName;
+   int64_t mArgValue;
+   uint64_t mStart;
+   bool mActive;
+
+public:
+   TraceSpan( const char* name, const char* argName = nullptr, int64_t argValue = 0 )
+      : mName( name ), mArgName( argName ), mArgValue( argValue ), mStart( 0 ),
+      mActive( Tracer::enabled() )
+   {
+      if ( mActive )
+         mStart = Tracer::now();
+   }
+
+   ~TraceSpan()
+   {
+      if ( mActive )
+         Tracer::record( TraceEvent{ mName, mArgName, mArgValue, mStart, Tracer::now() - mStart } );
+   }
+
+   TraceSpan( const TraceSpan& ) = delete;
+   TraceSpan& operator=( const TraceSpan& ) = delete;
+};
+
+#define TRACE_CAT2( a, b ) a ## b
+#define TRACE_CAT( a, b ) TRACE_CAT2( a, b )
+#define TRACE_SPAN( ... ) TraceSpan TRACE_CAT( traceSpan_, __LINE__ )( __VA_ARGS__ )